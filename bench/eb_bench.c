@@ -0,0 +1,710 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+// Benchmark suite, every scenario prints one JSON object of the "results"
+// array on stdout. Event counts and seeds are fixed so that runs of two
+// releases can be compared.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "event_bus.h"
+#include "event_bus_stats.h"
+#include "event_bus_worker.h"
+#include "event_bus_trace.h"
+#include "event_bus_shm.h"
+
+#define BENCH_LOOKUPS               (1U << 22)
+#define BENCH_DIRECT_EVENTS         (1U << 18)
+#define BENCH_INDIRECT_EVENTS       (1U << 15)
+#define BENCH_WORK_EVENTS           (1U << 15)
+#define BENCH_WORK_NS               20000
+#define BENCH_SHARD_EVENTS          (1U << 18)
+#define BENCH_SHARD_IDS             64
+#define BENCH_SHARD_PUBLISHERS      8
+#define BENCH_SHARD_CB_NS           1000
+#define BENCH_MAX_PUBLISHERS        16
+#define BENCH_MAX_SUBSCRIBERS       4
+#define BENCH_DRAIN_TIMEOUT_NS      (10ULL * 1000000000ULL)
+#define BENCH_MAX_PAYLOAD           4096
+#define BENCH_SHM_EVENTS            (1U << 18)
+#define BENCH_SHM_PACED_EVENTS      (1U << 14)
+#define BENCH_SHM_PACE_NS           20000
+#define BENCH_SHM_NAME              "/eb_bench"
+
+#if EB_USE_MPSC_RING
+#define BENCH_INBOX                 "ring"
+#else
+#define BENCH_INBOX                 "queue"
+#endif
+
+typedef struct bench_scn_t
+{
+    const char *name;
+    uint32_t nb_pub;
+    uint32_t nb_sub;
+    bool direct;
+    bool mixed_prio;
+    uint32_t len;
+    uint32_t batch;
+}bench_scn_t;
+
+typedef struct bench_pub_t
+{
+    pthread_t thread;
+    const bench_scn_t *scn;
+    uint32_t evt_id;
+    uint32_t nb;
+    uint32_t prio;
+    uint32_t failed;
+}bench_pub_t;
+
+static eb_t bus;
+#ifdef EB_EVT_LOOKUP_SIZE
+static eb_lookup_t lookup;
+static uint32_t ids[MAX_NB_EVENTS];
+#endif
+static uint8_t payload[BENCH_MAX_PAYLOAD];
+static atomic_uint received;
+static atomic_uint published;
+static uint32_t nb_results = 0;
+static uint32_t next_evt_id = 0x1000;
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef EB_EVT_LOOKUP_SIZE
+static uint32_t bench_rand(uint32_t *seed)
+{
+    // xorshift32, deterministic across runs
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+#endif
+
+static void bench_json_begin(const char *scenario)
+{
+    printf("%s\n    {\"scenario\": \"%s\"", nb_results > 0 ? "," : "", scenario);
+}
+
+static void bench_json_end(void)
+{
+    printf("}");
+    fflush(stdout);
+    nb_results++;
+}
+
+static void bench_json_lat(const char *key, uint32_t kind)
+{
+    eb_lat_stats_t lat;
+
+    eb_stats_get(kind, &lat, true);
+    printf(", \"%s\": {\"count\": %lu, \"mean\": %lu, \"p50\": %lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu}", key,
+        (unsigned long)lat.count, (unsigned long)lat.mean, (unsigned long)lat.p50, (unsigned long)lat.p99,
+        (unsigned long)lat.p999, (unsigned long)lat.max);
+}
+
+static void bench_json_alloc(void)
+{
+    printf(", \"payloads\": {\"inline\": %lu, \"pool\": %lu, \"heap\": %lu}",
+        (unsigned long)eb_stats_get_alloc(EB_STATS_ALLOC_INLINE, true),
+        (unsigned long)eb_stats_get_alloc(EB_STATS_ALLOC_POOL, true),
+        (unsigned long)eb_stats_get_alloc(EB_STATS_ALLOC_HEAP, true));
+}
+
+#ifdef EB_EVT_LOOKUP_SIZE
+static int32_t bench_linear_find(uint32_t nb, uint32_t id)
+{
+    uint32_t i;
+
+    for(i = 0 ; i < nb ; i++){
+        if(ids[i] == id){
+            return (int32_t)i;
+        }
+    }
+
+    return -1;
+}
+
+// eb_get_event cost against the number of registered event ids, compared
+// with the former linear scan
+static void bench_lookup(uint32_t nb)
+{
+    uint32_t i;
+    uint32_t seed = 0x2545F491;
+    uint64_t t;
+    uint64_t table_ns;
+    uint64_t linear_ns;
+    volatile int32_t sink = 0;
+    uint32_t nb_linear = BENCH_LOOKUPS / nb;
+
+    eb_lookup_init(&lookup);
+    for(i = 0 ; i < nb ; i++){
+        // module style ids: module number in the upper half
+#if EB_EVT_LOOKUP == EB_EVT_LOOKUP_DIRECT
+        ids[i] = i;
+#else
+        ids[i] = ((i / 64) << 16) | (i % 64);
+#endif
+        eb_lookup_insert(&lookup, ids[i], i);
+    }
+
+    t = bench_now_ns();
+    for(i = 0 ; i < BENCH_LOOKUPS ; i++){
+        sink += eb_lookup_find(&lookup, ids[bench_rand(&seed) % nb]);
+    }
+    table_ns = bench_now_ns() - t;
+
+    t = bench_now_ns();
+    for(i = 0 ; i < nb_linear ; i++){
+        sink += bench_linear_find(nb, ids[bench_rand(&seed) % nb]);
+    }
+    linear_ns = bench_now_ns() - t;
+
+    bench_json_begin("lookup");
+    printf(", \"events\": %lu, \"table_ns\": %.2f, \"linear_ns\": %.2f", (unsigned long)nb,
+        (double)table_ns / BENCH_LOOKUPS, (double)linear_ns / nb_linear);
+    bench_json_end();
+    (void)sink;
+}
+#endif
+
+static int32_t bench_count_cb(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg)
+{
+    (void)app_ctx;
+    (void)event_id;
+    (void)data;
+    (void)len;
+    (void)arg;
+
+    atomic_fetch_add_explicit(&received, 1, memory_order_relaxed);
+    return 0;
+}
+
+// a callback subscribes only once per event, fan-out needs distinct ones
+static int32_t bench_count_cb1(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg)
+{
+    return bench_count_cb(app_ctx, event_id, data, len, arg);
+}
+
+static int32_t bench_count_cb2(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg)
+{
+    return bench_count_cb(app_ctx, event_id, data, len, arg);
+}
+
+static int32_t bench_count_cb3(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg)
+{
+    return bench_count_cb(app_ctx, event_id, data, len, arg);
+}
+
+static eb_sub_cb_t *const bench_count_cbs[BENCH_MAX_SUBSCRIBERS] = {
+    bench_count_cb, bench_count_cb1, bench_count_cb2, bench_count_cb3
+};
+
+static void *bench_pub_thread(void *arg)
+{
+    bench_pub_t *pub = (bench_pub_t *)arg;
+    const bench_scn_t *scn = pub->scn;
+    eb_pub_msg_t msgs[EB_DISPATCH_BATCH];
+    uint32_t i;
+
+    for(i = 0 ; i < EB_DISPATCH_BATCH ; i++){
+        msgs[i].evt_id = pub->evt_id;
+        msgs[i].data = payload;
+        msgs[i].len = scn->len;
+    }
+
+    for(i = 0 ; i < pub->nb ; i += scn->batch){
+        atomic_fetch_add(&published, scn->batch);
+
+        if(scn->batch > 1){
+            if(eb_pub_batch(&bus, msgs, scn->batch, pub->prio)){
+                pub->failed += scn->batch;
+            }
+        }else if(eb_pub(&bus, pub->evt_id, payload, scn->len, pub->prio)){
+            pub->failed++;
+        }
+    }
+
+    return NULL;
+}
+
+// nb_pub publisher threads publish to nb_sub subscribers of a dedicated event
+static void bench_run(const bench_scn_t *scn)
+{
+    uint32_t i;
+    uint32_t nb;
+    uint32_t failed = 0;
+    uint32_t expected;
+    uint32_t evt_id = next_evt_id++;
+    uint64_t t;
+    double elapsed;
+    bench_pub_t pubs[BENCH_MAX_PUBLISHERS];
+
+    for(i = 0 ; i < scn->nb_sub ; i++){
+        if(scn->direct){
+            eb_sub_direct(&bus, "bench_direct", evt_id, NULL, bench_count_cbs[i]);
+        }else{
+            eb_sub_indirect(&bus, "bench_indirect", evt_id, NULL, bench_count_cbs[i]);
+        }
+    }
+
+    nb = scn->direct ? BENCH_DIRECT_EVENTS : BENCH_INDIRECT_EVENTS;
+    nb = (nb / (scn->nb_pub * scn->batch)) * scn->batch;
+    atomic_store(&received, 0);
+    atomic_store(&published, 0);
+    eb_stats_reset();
+
+    t = bench_now_ns();
+    for(i = 0 ; i < scn->nb_pub ; i++){
+        pubs[i].scn = scn;
+        pubs[i].evt_id = evt_id;
+        pubs[i].nb = nb;
+        pubs[i].prio = scn->mixed_prio ? i % EB_NB_PRIO_LEVELS : EVENT_BUS_LOW_PRIO;
+        pubs[i].failed = 0;
+        pthread_create(&pubs[i].thread, NULL, bench_pub_thread, &pubs[i]);
+    }
+
+    for(i = 0 ; i < scn->nb_pub ; i++){
+        pthread_join(pubs[i].thread, NULL);
+        failed += pubs[i].failed;
+    }
+
+    // events dropped by the bus never arrive, give up after a while
+    expected = (nb * scn->nb_pub - failed) * scn->nb_sub;
+    while(atomic_load(&received) < expected && bench_now_ns() - t < BENCH_DRAIN_TIMEOUT_NS){
+        sched_yield();
+    }
+    elapsed = (double)(bench_now_ns() - t) / 1e9;
+
+    bench_json_begin(scn->name);
+    printf(", \"inbox\": \"%s\", \"mode\": \"%s\", \"publishers\": %lu, \"subscribers\": %lu, \"payload\": %lu, \"batch\": %lu",
+        BENCH_INBOX, scn->direct ? "direct" : "indirect", (unsigned long)scn->nb_pub, (unsigned long)scn->nb_sub,
+        (unsigned long)scn->len, (unsigned long)scn->batch);
+    printf(", \"events\": %lu, \"failed\": %lu, \"lost\": %lu, \"events_per_s\": %.0f, \"callbacks_per_s\": %.0f",
+        (unsigned long)(nb * scn->nb_pub), (unsigned long)failed, (unsigned long)(expected - atomic_load(&received)),
+        (double)(nb * scn->nb_pub - failed) / elapsed, (double)atomic_load(&received) / elapsed);
+    bench_json_lat("queue_ns", EB_STATS_LAT_QUEUE);
+    bench_json_lat("handoff_ns", EB_STATS_LAT_HANDOFF);
+    bench_json_lat("callback_ns", EB_STATS_LAT_CB);
+    bench_json_alloc();
+    bench_json_end();
+}
+
+static int32_t bench_work_cb(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg)
+{
+    uint64_t end = bench_now_ns() + BENCH_WORK_NS;
+
+    (void)app_ctx;
+    (void)event_id;
+    (void)data;
+    (void)len;
+    (void)arg;
+
+    // stand-in for a subscriber doing real work
+    while(bench_now_ns() < end){
+    }
+
+    atomic_fetch_add_explicit(&received, 1, memory_order_relaxed);
+    return 0;
+}
+
+// indirect subscriber throughput against the worker pool size, the pool is
+// global so each size runs in its own process
+static void bench_workers(uint32_t nb_workers)
+{
+    uint32_t i;
+    uint32_t failed = 0;
+    uint32_t evt_id = next_evt_id++;
+    uint64_t t;
+    double elapsed;
+    eb_cfg_t cfg;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid != 0){
+        waitpid(pid, &status, 0);
+        if(WIFEXITED(status) && WEXITSTATUS(status) == 0){
+            nb_results++;
+        }
+        return;
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.nb_workers = nb_workers;
+    if(eb_init_cfg(&bus, NULL, &cfg)){
+        exit(1);
+    }
+    eb_sub_indirect(&bus, "bench_work", evt_id, NULL, bench_work_cb);
+
+    atomic_store(&received, 0);
+    t = bench_now_ns();
+    for(i = 0 ; i < BENCH_WORK_EVENTS ; i++){
+        if(eb_pub(&bus, evt_id, NULL, 0, EVENT_BUS_LOW_PRIO)){
+            failed++;
+        }
+    }
+
+    while(atomic_load(&received) < BENCH_WORK_EVENTS - failed && bench_now_ns() - t < BENCH_DRAIN_TIMEOUT_NS){
+        sched_yield();
+    }
+    elapsed = (double)(bench_now_ns() - t) / 1e9;
+
+    bench_json_begin("workers");
+    printf(", \"workers\": %lu, \"work_ns\": %lu, \"events\": %lu, \"failed\": %lu, \"events_per_s\": %.0f", (unsigned long)nb_workers,
+        (unsigned long)BENCH_WORK_NS, (unsigned long)BENCH_WORK_EVENTS, (unsigned long)failed, (double)atomic_load(&received) / elapsed);
+    bench_json_lat("handoff_ns", EB_STATS_LAT_HANDOFF);
+    bench_json_end();
+    exit(0);
+}
+
+static int32_t bench_shard_cb(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg)
+{
+    uint64_t end = bench_now_ns() + BENCH_SHARD_CB_NS;
+
+    (void)app_ctx;
+    (void)event_id;
+    (void)data;
+    (void)len;
+    (void)arg;
+
+    // direct subscriber cost, paid by the dispatcher
+    while(bench_now_ns() < end){
+    }
+
+    atomic_fetch_add_explicit(&received, 1, memory_order_relaxed);
+    return 0;
+}
+
+static void *bench_shard_pub(void *arg)
+{
+    bench_pub_t *pub = (bench_pub_t *)arg;
+    uint32_t i;
+
+    for(i = 0 ; i < pub->nb ; i++){
+        if(eb_pub(&bus, pub->evt_id + (i % (BENCH_SHARD_IDS / BENCH_SHARD_PUBLISHERS)) * BENCH_SHARD_PUBLISHERS, NULL, 0, EVENT_BUS_LOW_PRIO)){
+            pub->failed++;
+        }
+    }
+
+    return NULL;
+}
+
+// direct dispatch throughput against the number of dispatchers, publishers
+// spread their events over BENCH_SHARD_IDS ids. Each count runs in its own
+// process like the worker pool sizes
+static void bench_dispatchers(uint32_t nb_dispatchers)
+{
+    uint32_t i;
+    uint32_t failed = 0;
+    uint32_t nb = BENCH_SHARD_EVENTS / BENCH_SHARD_PUBLISHERS;
+    uint32_t evt_id = next_evt_id;
+    uint64_t t;
+    double elapsed;
+    bench_pub_t pubs[BENCH_SHARD_PUBLISHERS];
+    eb_cfg_t cfg;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid != 0){
+        waitpid(pid, &status, 0);
+        if(WIFEXITED(status) && WEXITSTATUS(status) == 0){
+            nb_results++;
+        }
+        return;
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.nb_dispatchers = nb_dispatchers;
+    if(eb_init_cfg(&bus, NULL, &cfg)){
+        exit(1);
+    }
+    for(i = 0 ; i < BENCH_SHARD_IDS ; i++){
+        eb_sub_direct(&bus, "bench_shard", evt_id + i, NULL, bench_shard_cb);
+    }
+
+    atomic_store(&received, 0);
+    t = bench_now_ns();
+    for(i = 0 ; i < BENCH_SHARD_PUBLISHERS ; i++){
+        pubs[i].evt_id = evt_id + i;
+        pubs[i].nb = nb;
+        pubs[i].failed = 0;
+        pthread_create(&pubs[i].thread, NULL, bench_shard_pub, &pubs[i]);
+    }
+
+    for(i = 0 ; i < BENCH_SHARD_PUBLISHERS ; i++){
+        pthread_join(pubs[i].thread, NULL);
+        failed += pubs[i].failed;
+    }
+
+    while(atomic_load(&received) < nb * BENCH_SHARD_PUBLISHERS - failed && bench_now_ns() - t < BENCH_DRAIN_TIMEOUT_NS){
+        sched_yield();
+    }
+    elapsed = (double)(bench_now_ns() - t) / 1e9;
+
+    bench_json_begin("dispatchers");
+    printf(", \"inbox\": \"%s\", \"dispatchers\": %lu, \"publishers\": %lu, \"callback_ns\": %lu, \"events\": %lu, \"failed\": %lu, \"events_per_s\": %.0f",
+        BENCH_INBOX, (unsigned long)bus.nb_shards, (unsigned long)BENCH_SHARD_PUBLISHERS, (unsigned long)BENCH_SHARD_CB_NS,
+        (unsigned long)(nb * BENCH_SHARD_PUBLISHERS), (unsigned long)failed, (double)atomic_load(&received) / elapsed);
+    bench_json_lat("queue_ns", EB_STATS_LAT_QUEUE);
+    bench_json_end();
+    exit(0);
+}
+
+#if EB_USE_SHM
+static uint64_t shm_first_ns;
+static uint64_t shm_last_ns;
+
+static int32_t bench_shm_cb(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg)
+{
+    uint64_t now = bench_now_ns();
+
+    (void)app_ctx;
+    (void)event_id;
+    (void)data;
+    (void)len;
+    (void)arg;
+
+    // the publisher attaches after the ring is created, time the events only
+    if(atomic_fetch_add_explicit(&received, 1, memory_order_relaxed) == 0){
+        shm_first_ns = now;
+    }
+    shm_last_ns = now;
+
+    return 0;
+}
+
+// remote publisher, runs in its own process without a bus. A paced
+// publisher leaves the receiver idle between events
+static void bench_shm_pub(uint32_t evt_id, uint32_t len, bool in_place, uint32_t nb, uint32_t pace_ns)
+{
+    eb_shm_t shm;
+    void *data;
+    uint32_t i;
+    uint64_t t = bench_now_ns();
+
+    while(eb_shm_open(&shm, BENCH_SHM_NAME)){
+        if(bench_now_ns() - t > BENCH_DRAIN_TIMEOUT_NS){
+            exit(1);
+        }
+        usleep(1000);
+    }
+
+    for(i = 0 ; i < nb ; i++){
+        t = bench_now_ns() + pace_ns;
+        if(!in_place){
+            eb_shm_pub(&shm, evt_id, payload, len, EVENT_BUS_LOW_PRIO);
+        }else if(eb_shm_alloc(&shm, len, &data) == EVT_BUS_ERR_OK){
+            // the payload is built in the ring, only its sequence number here
+            if(len >= sizeof(i)){
+                memcpy(data, &i, sizeof(i));
+            }
+            eb_shm_commit(&shm, data, evt_id, EVENT_BUS_LOW_PRIO);
+        }
+
+        while(pace_ns > 0 && bench_now_ns() < t){
+        }
+    }
+
+    eb_shm_close(&shm);
+    exit(0);
+}
+
+// events published by another process through a shared memory ring to a
+// direct subscriber. The queueing delay runs from the remote publish to the
+// dispatch, both processes read the same monotonic clock. Unpaced runs give
+// the throughput, paced ones the latency of a receiver waiting on its futex
+static void bench_shm(uint32_t len, bool in_place, uint32_t pace_ns)
+{
+    uint32_t nb = pace_ns > 0 ? BENCH_SHM_PACED_EVENTS : BENCH_SHM_EVENTS;
+    uint32_t evt_id = next_evt_id++;
+    uint64_t t;
+    double elapsed;
+    eb_shm_t shm;
+    pid_t pid;
+    pid_t pub;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid != 0){
+        waitpid(pid, &status, 0);
+        if(WIFEXITED(status) && WEXITSTATUS(status) == 0){
+            nb_results++;
+        }
+        return;
+    }
+
+    // before eb_init, the publisher must not inherit the bus threads
+    pub = fork();
+    if(pub == 0){
+        bench_shm_pub(evt_id, len, in_place, nb, pace_ns);
+    }
+
+    if(eb_init(&bus, NULL)){
+        kill(pub, SIGKILL);
+        exit(1);
+    }
+    eb_sub_direct(&bus, "bench_shm", evt_id, NULL, bench_shm_cb);
+    atomic_store(&received, 0);
+    eb_stats_reset();
+
+    if(eb_shm_create(&shm, &bus, BENCH_SHM_NAME)){
+        kill(pub, SIGKILL);
+        exit(1);
+    }
+
+    t = bench_now_ns();
+    while(atomic_load(&received) < nb && bench_now_ns() - t < BENCH_DRAIN_TIMEOUT_NS){
+        usleep(1000);
+    }
+    waitpid(pub, &status, 0);
+    eb_shm_close(&shm);
+    elapsed = (double)(shm_last_ns - shm_first_ns) / 1e9;
+
+    bench_json_begin("shm");
+    printf(", \"mode\": \"%s\", \"payload\": %lu, \"ring\": %lu, \"pace_ns\": %lu, \"events\": %lu, \"lost\": %lu, \"events_per_s\": %.0f",
+        in_place ? "in_place" : "copy", (unsigned long)len, (unsigned long)EB_SHM_RING_LEN, (unsigned long)pace_ns,
+        (unsigned long)nb, (unsigned long)(nb - atomic_load(&received)), elapsed > 0 ? (double)atomic_load(&received) / elapsed : 0.0);
+    bench_json_lat("queue_ns", EB_STATS_LAT_QUEUE);
+    bench_json_lat("callback_ns", EB_STATS_LAT_CB);
+    bench_json_alloc();
+    bench_json_end();
+    exit(0);
+}
+#endif
+
+static const bench_scn_t scenarios[] = {
+    // name                 pub sub direct mixed  len   batch
+    { "direct_fanout",       1,  1, true,  false, 0,    1 },
+    { "direct_fanout",       1,  4, true,  false, 0,    1 },
+    { "indirect_fanout",     1,  1, false, false, 0,    1 },
+    { "indirect_fanout",     1,  4, false, false, 0,    1 },
+    { "mixed_prio",          4,  1, true,  true,  0,    1 },
+    { "payload",             1,  1, true,  false, 16,   1 },
+    { "payload",             1,  1, true,  false, 64,   1 },
+    { "payload",             1,  1, true,  false, 512,  1 },
+    { "payload",             1,  1, true,  false, 4096, 1 },
+    { "pub_x_sub",           4,  1, true,  false, 0,    1 },
+    { "pub_x_sub",           4,  4, true,  false, 0,    1 },
+    { "pub_x_sub",          16,  1, true,  false, 0,    1 },
+    { "pub_x_sub",          16,  4, true,  false, 0,    1 },
+    { "batch",               1,  1, true,  false, 0,    EB_DISPATCH_BATCH },
+};
+
+#if EB_USE_TRACE
+static int32_t bench_trace_write(void *ctx, const void *data, uint32_t len)
+{
+    return fwrite(data, 1, len, (FILE *)ctx) == len ? 0 : -1;
+}
+
+// the rings hold the last records of the run, see tools/eb_trace2json.py
+static void bench_trace_dump(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+
+    if(f == NULL || eb_trace_dump(bench_trace_write, f) < 0){
+        fprintf(stderr, "failed to write trace %s\n", path);
+    }
+
+    if(f != NULL){
+        fclose(f);
+    }
+}
+#endif
+
+// built with EB_USE_TRACE, the trace is written to the file given as argument
+int main(int argc, char *argv[])
+{
+    uint32_t nb;
+
+    (void)argc;
+    (void)argv;
+
+    memset(payload, 0xA5, sizeof(payload));
+
+    printf("{\n  \"version\": \"%d.%d.%d\",\n  \"results\": [", EVENT_BUS_MAJOR_REV, EVENT_BUS_MINOR_REV, EVENT_BUS_PATCH);
+
+#ifdef EB_EVT_LOOKUP_SIZE
+    for(nb = 16 ; nb <= MAX_NB_EVENTS && nb <= EB_EVT_LOOKUP_SIZE ; nb *= 4){
+        bench_lookup(nb);
+    }
+#endif
+
+    // before eb_init, forked children must not inherit the bus threads
+    for(nb = 1 ; nb <= MAX_NB_WORKERS ; nb *= 2){
+        bench_workers(nb);
+    }
+
+    for(nb = 1 ; nb <= EB_MAX_DISPATCHERS ; nb *= 2){
+        bench_dispatchers(nb);
+    }
+
+#if EB_USE_SHM
+    bench_shm(16, false, 0);
+    bench_shm(16, true, 0);
+    bench_shm(EB_SHM_MSG_LEN, false, 0);
+    bench_shm(EB_SHM_MSG_LEN, true, 0);
+    bench_shm(16, false, BENCH_SHM_PACE_NS);
+#endif
+
+    if(eb_init(&bus, NULL)){
+        printf("\n  ],\n  \"error\": \"event bus init failed\"\n}\n");
+        return 1;
+    }
+
+    for(nb = 0 ; nb < sizeof(scenarios) / sizeof(scenarios[0]) ; nb++){
+        bench_run(&scenarios[nb]);
+    }
+
+#if EB_USE_TRACE
+    if(argc > 1){
+        bench_trace_dump(argv[1]);
+    }
+#endif
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -41,13 +41,42 @@ set(EB_INC ${EB_INC}
 
 if(USE_FREERTOS)
     set(EB_SRC ${EB_SRC} "${CMAKE_CURRENT_LIST_DIR}/port/eb_freertos.c")
+elseif(USE_POSIX)
+    find_package(Threads REQUIRED)
+    set(EB_SRC ${EB_SRC} "${CMAKE_CURRENT_LIST_DIR}/port/eb_posix.c")
+    target_compile_definitions(event-bus
+        INTERFACE
+            USE_POSIX=1
+    )
+    target_link_libraries(event-bus
+        INTERFACE
+            Threads::Threads
+    )
+    # shm_open lives in librt before glibc 2.34
+    if(CMAKE_SYSTEM_NAME STREQUAL "Linux")
+        target_link_libraries(event-bus
+            INTERFACE
+                rt
+        )
+    endif()
 endif()
 
 set(EB_SRC ${EB_SRC}
     "${CMAKE_CURRENT_LIST_DIR}/src/event_bus.c"
     "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_worker.c"
     "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_supv.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_timer.c"
     "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_stats.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_trace.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_shm.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_hist.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_mpool.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_buf.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_subs.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_pattern.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_lookup.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_ring.c"
+    "${CMAKE_CURRENT_LIST_DIR}/src/event_bus_inbox.c"
 )
 
 target_include_directories(event-bus
@@ -58,4 +87,21 @@ target_include_directories(event-bus
 target_sources(event-bus
     INTERFACE
         ${EB_SRC}
-)
\ No newline at end of file
+)
+
+# host benchmarks, enable with -DEB_BUILD_BENCH=ON on a POSIX build
+if(USE_POSIX AND EB_BUILD_BENCH)
+    add_executable(event-bus-bench
+        "${CMAKE_CURRENT_LIST_DIR}/bench/eb_bench.c"
+    )
+
+    target_include_directories(event-bus-bench
+        PRIVATE
+            "${CMAKE_CURRENT_LIST_DIR}/bench"
+    )
+
+    target_link_libraries(event-bus-bench
+        PRIVATE
+            event-bus
+    )
+endif()
@@ -35,8 +35,10 @@
 #include <stdbool.h>
 #include <stdio.h> 
 #include <string.h> 
+#include <stdatomic.h>
 #include "event_bus_dflt_cfg.h"
 #include "event_bus_err.h"
+#include "event_bus_lookup.h"
 #include "eb_port.h"
 
 // Version 3.0.0
@@ -44,51 +46,305 @@
 #define EVENT_BUS_MINOR_REV     0
 #define EVENT_BUS_PATCH         0
 
+// priorities go from EVENT_BUS_LOW_PRIO to EB_NB_PRIO_LEVELS - 1
 #define EVENT_BUS_LOW_PRIO      0
-#define EVENT_BUS_HIGH_PRIO     1
+#define EVENT_BUS_HIGH_PRIO     (EB_NB_PRIO_LEVELS - 1)
 
 typedef int32_t (eb_sub_cb_t)(void *app_ctx, uint32_t event_id, void *data, uint32_t len, void *arg);
 
+// stats_id of a subscriber without histogram of its own
+#define EB_STATS_UNTRACKED      UINT32_MAX
+
 
 typedef struct eb_sub_t
 {
     char name[EB_SUB_NAME_MAX_LEN];
     void *arg;
     bool direct;
+    uint32_t deadline_ms;                       // indirect only, 0 for EB_MAX_SUB_LATENCY_MS
+    uint32_t stats_id;                          // eb_stats_intern(name) or EB_STATS_UNTRACKED
     eb_sub_cb_t *cb;
 }eb_sub_t;
 
+// ref of a table built at compile time, it is never counted nor freed
+#define EB_SUB_TBL_STATIC       UINT32_MAX
+
+// immutable once published, see event_bus_subs.h
+typedef struct eb_sub_tbl_t
+{
+    atomic_uint ref;
+    uint32_t nb_sub;
+    struct eb_sub_tbl_t *next;                  // retired tables
+    uint32_t epoch;                             // bus epoch when retired
+    eb_sub_t subs[];
+}eb_sub_tbl_t;
+
 typedef struct eb_evt_t
 {
     uint32_t id;
-    uint32_t nb_sub;
-    eb_sub_t subs[MAX_NB_SUBSCRIBERS];
+    _Atomic(eb_sub_tbl_t *) subs;               // NULL without subscriber
+    atomic_bool conflate;
+    _Atomic(void *) latest;                     // payload of the queued conflated message
+    atomic_uint merged;                         // payloads replaced before dispatch
+    atomic_uint policy;                         // eb_policy_t, EB_POLICY_DEFAULT follows the bus
+    atomic_uint dropped;
+    atomic_uint rejected;
+    atomic_uint published;                      // queued or merged
+    atomic_uint dispatched;
 }eb_evt_t;
 
+// the payload of a conflated message is taken from eb_evt_t at dispatch
+#define EB_MSG_CONFLATED        (1U << 0)
+#define EB_MSG_INLINE           (1U << 1)       // payload in inl, data is NULL
+
 typedef struct eb_msg_t
 {
     uint32_t evt_id;
-    eb_evt_t *evt;
+    eb_sub_tbl_t *subs;                         // set by the event bus thread
+    eb_sub_tbl_t *psubs;                        // mask and range subscribers
     uint32_t len;
     void *data;
+    uint32_t pub_ns;                            // low 32 bits of eb_get_time_ns()
+    uint32_t flags;
+#if EB_INLINE_PAYLOAD_LEN > 0
+    _Alignas(8) uint8_t inl[EB_INLINE_PAYLOAD_LEN];
+#endif
 }eb_msg_t;
 
+#if EB_USE_MPSC_RING
+#define EB_RING_LEN                 EB_NEXT_POW2(EB_QUEUE_LEN)
+
+typedef struct eb_ring_cell_t
+{
+    atomic_uint seq;
+    eb_msg_t msg;
+}eb_ring_cell_t;
+
+typedef struct eb_ring_t
+{
+    _Alignas(EB_CACHE_LINE) atomic_uint tail;   // next slot reserved by publishers
+    _Alignas(EB_CACHE_LINE) atomic_uint head;   // next slot read by the dispatcher or an evicting publisher
+    eb_ring_cell_t cells[EB_RING_LEN];
+}eb_ring_t;
+#endif
+
+// called for a message evicted by a drop policy, releases its payload
+typedef void (eb_inbox_drop_cb_t)(void *ctx, eb_msg_t *msg);
+
+// one FIFO per priority level sharing EB_QUEUE_LEN slots, the dispatcher
+// sleeps on a single semaphore
+typedef struct eb_inbox_t
+{
+#if EB_USE_MPSC_RING
+    eb_ring_t rings[EB_NB_PRIO_LEVELS];
+#else
+    eb_queue_t queues[EB_NB_PRIO_LEVELS];
+#endif
+    atomic_uint total;                          // slots reserved across levels
+    atomic_uint high;                           // high watermark of total
+    atomic_uint waiters;                        // publishers wait on space
+    eb_sem_t space;
+    eb_inbox_drop_cb_t *drop;
+    void *drop_ctx;
+    atomic_uint depth[EB_NB_PRIO_LEVELS];
+    uint32_t credit[EB_NB_PRIO_LEVELS];
+    atomic_uint sleeping;                       // dispatcher waits on wake
+    atomic_uint kicked;                         // wakeup without message
+    eb_sem_t wake;
+}eb_inbox_t;
+
+// event ids are hashed onto the dispatchers, each one has its own inbox and
+// thread. The events of a given id go through the same dispatcher and keep
+// their order
+typedef struct eb_shard_t
+{
+    struct eb_t *bus;
+    eb_inbox_t inbox;
+    atomic_uint epoch;                          // bus epoch seen by the current batch, 0 between batches
+    eb_thread_t thread;
+    char name[EB_WORKER_MAX_NAME_LEN];
+}eb_shard_t;
+
+typedef struct eb_pub_msg_t
+{
+    uint32_t evt_id;
+    void *data;
+    uint32_t len;
+}eb_pub_msg_t;
+
+// what a publisher does when the inbox is full
+typedef enum eb_policy_t
+{
+    EB_POLICY_DEFAULT = 0,                      // per event: follow the bus policy
+    EB_POLICY_BLOCK,                            // wait up to the publish timeout
+    EB_POLICY_FAIL_FAST,                        // reject at once
+    EB_POLICY_DROP_OLDEST,                      // evict the oldest message of the same priority
+    EB_POLICY_DROP_LOWEST,                      // evict the oldest message of the lowest priority
+}eb_policy_t;
+
+typedef struct eb_overflow_t
+{
+    uint32_t dropped;                           // evicted to make room
+    uint32_t rejected;                          // publish failed on a full inbox
+    uint32_t high_watermark;                    // highest inbox depth
+}eb_overflow_t;
+
+// the inbox depth is not tracked per event, only the bus reports a watermark
+typedef struct eb_evt_overflow_t
+{
+    uint32_t dropped;                           // evicted to make room
+    uint32_t rejected;                          // publish failed on a full inbox
+}eb_evt_overflow_t;
+
+typedef struct eb_cfg_t
+{
+    uint32_t nb_workers;                        // size of the worker pool
+    uint32_t nb_dispatchers;                    // up to EB_MAX_DISPATCHERS, 0 for 1
+    uint32_t policy;                            // eb_policy_t, 0 for EB_PUBLISH_POLICY
+    uint32_t pub_timeout;                       // ms, 0 for EB_PUBLISH_TIMEOUT
+    // cores each thread may run on, bit n for core n, 0 to leave it to the
+    // scheduler. Workers are shared, the first bus initialized pins them
+    uint32_t dispatcher_affinity[EB_MAX_DISPATCHERS];
+    uint32_t worker_affinity[MAX_NB_WORKERS];
+}eb_cfg_t;
+
+// bus counters, see eb_stats_snapshot
+enum eb_stats_cnt
+{
+    EB_STATS_CNT_PUBLISHED = 0,                 // queued or merged
+    EB_STATS_CNT_DISPATCHED,                    // handed to the subscribers
+    EB_STATS_CNT_ALLOC_FAILED,                  // no payload buffer left
+    EB_STATS_CNT_PUB_TIMEOUT,                   // blocking publish timed out on a full inbox
+    EB_STATS_CNT_NO_WORKER,                     // mailboxes full past EB_WORKER_POST_TIMEOUT
+    EB_STATS_CNT_DEFERRED,                      // subscribers moved to another worker past a deadline
+    EB_STATS_NB_CNT,
+};
+
+typedef struct eb_counters_t
+{
+    _Alignas(EB_CACHE_LINE) atomic_uint cnt[EB_STATS_NB_CNT];
+    atomic_ullong busy_ns;                      // time workers spent on the events of the bus
+}eb_counters_t;
+
+// counters only go up and wrap around, rates are computed from the
+// difference of two snapshots
+typedef struct eb_snapshot_t
+{
+    uint32_t cnt[EB_STATS_NB_CNT];              // enum eb_stats_cnt
+    uint32_t dropped;
+    uint32_t rejected;
+    uint32_t depth;                             // messages queued across dispatchers
+    uint32_t high_watermark;                    // highest depth of a dispatcher inbox
+    uint64_t busy_ns;
+    uint32_t nb_evt;                            // events known by the bus
+}eb_snapshot_t;
+
+typedef struct eb_snapshot_evt_t
+{
+    uint32_t event_id;
+    uint32_t published;
+    uint32_t dispatched;
+    uint32_t merged;
+    uint32_t dropped;
+    uint32_t rejected;
+}eb_snapshot_evt_t;
+
+// 0 is never a valid timer id
+typedef uint32_t eb_timer_id_t;
+
+#if EB_MAX_TIMERS > 0
+#define EB_TIMER_SLOTS              (1U << EB_TIMER_WHEEL_BITS)
+
+typedef struct eb_timer_t
+{
+    struct eb_timer_t *next;
+    struct eb_timer_t *prev;
+    uint32_t expire;                            // wheel tick
+    uint32_t period;                            // wheel ticks, 0 for a one shot timer
+    uint32_t evt_id;
+    uint32_t prio;
+    uint32_t len;
+    void *data;                                 // payload buffer, one reference per firing
+    uint16_t gen;                               // bumped on release, stale ids don't match
+    uint8_t level;
+    uint8_t slot;
+}eb_timer_t;
+
+// hierarchical timer wheel run by the first dispatcher, see event_bus_timer.h
+typedef struct eb_timers_t
+{
+    eb_mutex_t lock;
+    eb_timer_t pool[EB_MAX_TIMERS];
+    eb_timer_t *free;
+    eb_timer_t *slots[EB_TIMER_LEVELS][EB_TIMER_SLOTS];
+    uint64_t busy[EB_TIMER_LEVELS];             // non empty slots
+    uint32_t now;                               // next wheel tick to run
+    atomic_uint nb;                             // armed timers
+    bool armed;                                 // the dispatcher wakes up at wake_at
+    uint32_t wake_at;
+}eb_timers_t;
+#endif
+
 typedef struct eb_t
 {
     uint32_t nb_evt;
     eb_evt_t events[MAX_NB_EVENTS];
+#ifdef EB_EVT_LOOKUP_SIZE
+    eb_lookup_t lookup;
+#endif
     eb_sub_t all_sub;
+    _Atomic(eb_sub_tbl_t *) retired;
+    _Atomic(struct eb_pat_idx_t *) patterns;    // see event_bus_pattern.h
+    _Atomic(struct eb_pat_idx_t *) retired_pat;
     eb_mutex_t mutex;
-    eb_queue_t queue;
+    eb_shard_t shards[EB_MAX_DISPATCHERS];
+    uint32_t nb_shards;
+    atomic_uint epoch;                          // odd, moves on every retired table
+    uint32_t policy;
+    uint32_t pub_timeout;
+    atomic_uint dropped;
+    atomic_uint rejected;
+    eb_counters_t counters[EB_STATS_NB_SHARDS];
+#if EB_MAX_TIMERS > 0
+    eb_timers_t timers;
+#endif
     void *app_ctx;
 }eb_t;
 
 int32_t eb_init(eb_t *bus, void *app_ctx);
+int32_t eb_init_cfg(eb_t *bus, void *app_ctx, const eb_cfg_t *cfg);
 int32_t eb_unsub(eb_t *bus, uint32_t event_id, eb_sub_cb_t *cb);
 int32_t eb_sub_direct(eb_t *bus, const char *name, uint32_t event_id, void *arg, eb_sub_cb_t *cb);
 int32_t eb_sub_indirect(eb_t *bus, const char *name, uint32_t event_id, void *arg, eb_sub_cb_t *cb);
 int32_t eb_sub_all_direct(eb_t *bus, void *arg, eb_sub_cb_t *cb);
 int32_t eb_sub_all_indirect(eb_t *bus, void *arg, eb_sub_cb_t *cb);
+int32_t eb_sub_mask(eb_t *bus, const char *name, uint32_t value, uint32_t mask, bool direct, void *arg, eb_sub_cb_t *cb);
+int32_t eb_sub_range(eb_t *bus, const char *name, uint32_t first, uint32_t last, bool direct, void *arg, eb_sub_cb_t *cb);
+int32_t eb_unsub_pattern(eb_t *bus, eb_sub_cb_t *cb);
+int32_t eb_sub_deadline(eb_t *bus, uint32_t event_id, eb_sub_cb_t *cb, uint32_t deadline_ms);
 int32_t eb_pub(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio);
+// eb_pub with the publish time, low 32 bits of eb_get_time_ns(), taken by the
+// caller. Transports relaying another process keep the remote publish time
+int32_t eb_pub_at(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio, uint32_t pub_ns);
+int32_t eb_pub_batch(eb_t *bus, const eb_pub_msg_t *msgs, uint32_t nb, uint32_t prio);
+int32_t eb_pub_delayed(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio, uint32_t delay_ms, eb_timer_id_t *id);
+int32_t eb_pub_periodic(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio, uint32_t period_ms, eb_timer_id_t *id);
+int32_t eb_timer_cancel(eb_t *bus, eb_timer_id_t id);
+uint32_t eb_get_depth(eb_t *bus, uint32_t prio);
+int32_t eb_conflate(eb_t *bus, uint32_t event_id, bool enable);
+uint32_t eb_get_merged(eb_t *bus, uint32_t event_id);
+int32_t eb_set_policy(eb_t *bus, uint32_t event_id, eb_policy_t policy);
+void eb_get_overflow(eb_t *bus, eb_overflow_t *ovf);
+int32_t eb_get_evt_overflow(eb_t *bus, uint32_t event_id, eb_evt_overflow_t *ovf);
+// fills snap and the counters of up to nb_evts events, returns the number
+// of events written. evts may be NULL
+uint32_t eb_stats_snapshot(eb_t *bus, eb_snapshot_t *snap, eb_snapshot_evt_t *evts, uint32_t nb_evts);
+
+// zero-copy publish: loan a payload buffer, fill it in place then hand it
+// over to eb_pub_buf which releases it once every subscriber has run, even
+// on error. eb_buf_free gives back a loaned buffer that won't be published
+int32_t eb_buf_alloc(eb_t *bus, uint32_t len, void **data);
+void eb_buf_free(void *data);
+int32_t eb_pub_buf(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio);
 
 #endif // __EVENT_BUS_H__
\ No newline at end of file
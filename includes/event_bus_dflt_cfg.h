@@ -46,6 +46,11 @@
 #define MAX_NB_WORKERS              4
 #endif
 
+// dispatcher threads a bus can be configured with, see eb_cfg_t
+#ifndef EB_MAX_DISPATCHERS
+#define EB_MAX_DISPATCHERS          1
+#endif
+
 #ifndef MAX_SIMLT_EVT
 #define MAX_SIMLT_EVT               8
 #endif
@@ -66,22 +71,43 @@
 #error "EB_WORKER_PRIO must be set"
 #endif
 
-#ifndef EB_QUEUE_PERIOD
-#define EB_QUEUE_PERIOD            (50)
+// number of events waiting in each worker mailbox, idle workers steal the
+// oldest waiting event of busy workers
+#ifndef EB_WORKER_QUEUE_LEN
+#define EB_WORKER_QUEUE_LEN        (4)
 #endif
 
 #ifndef EB_WORKER_QUEUE_PERIOD
 #define EB_WORKER_QUEUE_PERIOD     (2000)
 #endif
 
+// ms a dispatcher waits for room when every worker mailbox is full. The
+// inbox fills up meanwhile and publishers apply their policy. Bounded so
+// that workers blocked publishing to a full inbox can't stall the bus, the
+// event is dropped and counted in EB_STATS_CNT_NO_WORKER past it
+#ifndef EB_WORKER_POST_TIMEOUT
+#define EB_WORKER_POST_TIMEOUT     EB_MAX_SUB_LATENCY_MS
+#endif
+
 #ifndef EB_PUBLISH_TIMEOUT
 #define EB_PUBLISH_TIMEOUT         (200)
 #endif
 
+#ifndef EB_PUBLISH_POLICY
+#define EB_PUBLISH_POLICY          EB_POLICY_BLOCK
+#endif
+
+// inbox slots, shared by every priority level
 #ifndef EB_QUEUE_LEN
 #define EB_QUEUE_LEN               (16)
 #endif
 
+// maximum number of messages handled by the event bus thread per wakeup
+// and queued at once by eb_pub_batch
+#ifndef EB_DISPATCH_BATCH
+#define EB_DISPATCH_BATCH          (8)
+#endif
+
 #ifndef EB_WORKER_MAX_NAME_LEN
 #define EB_WORKER_MAX_NAME_LEN     (16)
 #endif
@@ -90,6 +116,7 @@
 #define EB_SUPV_MAX_TIMER          (4)
 #endif
 
+// default supervision deadline of indirect subscribers, see eb_sub_deadline
 #ifndef EB_MAX_SUB_LATENCY_MS
 #define EB_MAX_SUB_LATENCY_MS      (100)
 #endif
@@ -98,8 +125,197 @@
 #define EB_SUB_NAME_MAX_LEN        (16)
 #endif
 
-#ifndef EB_STAT_HIST_DEPTH
-#define EB_STAT_HIST_DEPTH         (4)
+// FreeRTOS port: time latencies with the Cortex-M DWT cycle counter (M3 and
+// above) instead of the RTOS tick
+#ifndef EB_USE_DWT
+#define EB_USE_DWT                 0
+#endif
+
+// latency histograms: 2^EB_LAT_HIST_SUB_BITS buckets per power of 2, the
+// precision of a percentile is 1/2^EB_LAT_HIST_SUB_BITS of its value
+#ifndef EB_LAT_HIST_SUB_BITS
+#define EB_LAT_HIST_SUB_BITS       (3)
+#endif
+
+// number of subscribers and event ids tracked with their own histogram,
+// the following ones only go to the global histogram
+#ifndef EB_STATS_NB_SUBS
+#define EB_STATS_NB_SUBS           (8)
+#endif
+
+#ifndef EB_STATS_NB_EVTS
+#define EB_STATS_NB_EVTS           (8)
+#endif
+
+// bus counters and latency histograms are split in cache line aligned
+// shards picked by eb_thread_index(), threads updating the same shard share
+// its cache lines. A shard holds 3 + EB_STATS_NB_SUBS + EB_STATS_NB_EVTS
+// histograms of about 1 KB each. FreeRTOS targets are mostly single core
+// and may have no thread index, they default to 1
+#ifndef EB_STATS_NB_SHARDS
+#ifdef USE_FREERTOS
+#define EB_STATS_NB_SHARDS         (1)
+#else
+#define EB_STATS_NB_SHARDS         (4)
+#endif
+#endif
+
+// mask and range subscriptions, a mask whose don't care bits are not all
+// low bits is split in up to EB_PAT_MAX_SPLIT ranges, each one counts in
+// EB_MAX_PATTERNS
+#ifndef EB_MAX_PATTERNS
+#define EB_MAX_PATTERNS            (16)
+#endif
+
+#ifndef EB_PAT_MAX_SPLIT
+#define EB_PAT_MAX_SPLIT           (4)
+#endif
+
+// event id lookup used by the dispatcher, subscribe and unsubscribe
+//  - EB_EVT_LOOKUP_LINEAR: scan of the registered events
+//  - EB_EVT_LOOKUP_HASH: open addressing hash table, any id
+//  - EB_EVT_LOOKUP_DIRECT: table indexed by id, ids must be below
+//    EB_EVT_DIRECT_MAX_ID
+#define EB_EVT_LOOKUP_LINEAR        0
+#define EB_EVT_LOOKUP_HASH          1
+#define EB_EVT_LOOKUP_DIRECT        2
+
+#ifndef EB_EVT_LOOKUP
+#define EB_EVT_LOOKUP               EB_EVT_LOOKUP_HASH
+#endif
+
+#ifndef EB_EVT_DIRECT_MAX_ID
+#define EB_EVT_DIRECT_MAX_ID        (256)
+#endif
+
+// number of priority levels, each level has its own FIFO and the levels share
+// the EB_QUEUE_LEN slots of the inbox. The dispatcher serves the highest
+// non-empty level first
+#ifndef EB_NB_PRIO_LEVELS
+#define EB_NB_PRIO_LEVELS           2
+#endif
+
+// optional weighted fairness between levels, e.g. { 1, 4 }: under load a
+// level is served up to its weight in a row before lower levels get their
+// turn. Strict priority when not defined
+// #define EB_PRIO_WEIGHTS          { 1, 4 }
+
+// lock-free multi-producer ring used as dispatcher inbox instead of the
+// port queue, publishers don't take any lock. The ring length is
+// EB_QUEUE_LEN rounded up to the next power of 2
+#ifndef EB_USE_MPSC_RING
+#define EB_USE_MPSC_RING            0
+#endif
+
+// delayed and periodic publishing, 0 removes the timer wheel
+#ifndef EB_MAX_TIMERS
+#define EB_MAX_TIMERS               (32)
+#endif
+
+// timer wheel resolution, delays and periods are rounded up to it
+#ifndef EB_TIMER_TICK_MS
+#define EB_TIMER_TICK_MS            (10)
+#endif
+
+// EB_TIMER_LEVELS wheels of 2^EB_TIMER_WHEEL_BITS slots (6 bits at most)
+// cover 2^(EB_TIMER_LEVELS * EB_TIMER_WHEEL_BITS) ticks, later timers wait
+// in the last wheel
+#ifndef EB_TIMER_WHEEL_BITS
+#define EB_TIMER_WHEEL_BITS         (5)
+#endif
+
+#ifndef EB_TIMER_LEVELS
+#define EB_TIMER_LEVELS             (4)
+#endif
+
+// binary trace of every stage a message goes through, see event_bus_trace.h
+#ifndef EB_USE_TRACE
+#define EB_USE_TRACE                0
+#endif
+
+// records kept per trace ring, a power of 2. A record is 32 bytes
+#ifndef EB_TRACE_DEPTH
+#define EB_TRACE_DEPTH              (1024)
+#endif
+
+// threads are spread over the rings by eb_thread_index(), a thread has a ring
+// of its own while there are no more threads than rings
+#ifndef EB_TRACE_NB_RINGS
+#define EB_TRACE_NB_RINGS           (8)
+#endif
+
+// shared memory transport between processes, Linux only. See
+// event_bus_shm.h
+#ifndef EB_USE_SHM
+#define EB_USE_SHM                  0
+#endif
+
+// messages a shared memory ring holds, a power of 2
+#ifndef EB_SHM_RING_LEN
+#define EB_SHM_RING_LEN             (256)
+#endif
+
+// largest payload carried by the ring, a slot takes it plus 24 bytes
+#ifndef EB_SHM_MSG_LEN
+#define EB_SHM_MSG_LEN              (256)
+#endif
+
+// ms a remote publisher waits on a full ring, 0 fails at once
+#ifndef EB_SHM_PUB_TIMEOUT
+#define EB_SHM_PUB_TIMEOUT          (EB_PUBLISH_TIMEOUT)
+#endif
+
+// permissions of the shared memory object, processes attaching to a ring
+// need read and write access
+#ifndef EB_SHM_MODE
+#define EB_SHM_MODE                 (0600)
+#endif
+
+#ifndef EB_SHM_NAME_MAX_LEN
+#define EB_SHM_NAME_MAX_LEN         (32)
+#endif
+
+// subscriber tables declared with EB_STATIC_EVT, needs GCC or Clang on an
+// ELF target, see event_bus_static.h
+#ifndef EB_USE_STATIC_SUBS
+#define EB_USE_STATIC_SUBS          0
+#endif
+
+// payloads up to this size are copied in the queued message instead of a
+// pool block. Every inbox slot and worker mailbox grows by it, 0 disables
+#ifndef EB_INLINE_PAYLOAD_LEN
+#define EB_INLINE_PAYLOAD_LEN      (32)
+#endif
+
+// payload memory pool size classes, a class with a count of 0 is disabled.
+// Classes must be declared from the smallest to the biggest block size
+#ifndef EB_MPOOL_CLASS0_SIZE
+#define EB_MPOOL_CLASS0_SIZE       (32)
+#endif
+
+#ifndef EB_MPOOL_CLASS0_COUNT
+#define EB_MPOOL_CLASS0_COUNT      (16)
+#endif
+
+#ifndef EB_MPOOL_CLASS1_SIZE
+#define EB_MPOOL_CLASS1_SIZE       (128)
+#endif
+
+#ifndef EB_MPOOL_CLASS1_COUNT
+#define EB_MPOOL_CLASS1_COUNT      (8)
+#endif
+
+#ifndef EB_MPOOL_CLASS2_SIZE
+#define EB_MPOOL_CLASS2_SIZE       (512)
+#endif
+
+#ifndef EB_MPOOL_CLASS2_COUNT
+#define EB_MPOOL_CLASS2_COUNT      (4)
+#endif
+
+// payloads bigger than the biggest class are allocated with eb_malloc
+#ifndef EB_MPOOL_HEAP_FALLBACK
+#define EB_MPOOL_HEAP_FALLBACK     1
 #endif
 
 #ifndef EB_USE_CUSTOM_EVT
@@ -109,10 +325,22 @@
 #define EB_WORKER_EXIT_STATUS       0
 #endif
 
+#ifndef EB_CACHE_LINE
+#define EB_CACHE_LINE               64
+#endif
+
 #ifndef MIN 
 #define MIN(a,b)                   (a > b ? b : a)
 #endif
 
+// round up to the next power of 2, usable in constant expressions
+#define EB_P2_1(x)                  ((x) | ((x) >> 1))
+#define EB_P2_2(x)                  (EB_P2_1(x) | (EB_P2_1(x) >> 2))
+#define EB_P2_4(x)                  (EB_P2_2(x) | (EB_P2_2(x) >> 4))
+#define EB_P2_8(x)                  (EB_P2_4(x) | (EB_P2_4(x) >> 8))
+#define EB_P2_16(x)                 (EB_P2_8(x) | (EB_P2_8(x) >> 16))
+#define EB_NEXT_POW2(x)             (EB_P2_16((uint32_t)(x) - 1) + 1)
+
 #ifndef eb_log_trace
 #define eb_log_trace(...)
 #endif
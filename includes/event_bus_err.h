@@ -42,6 +42,11 @@ enum eb_err_list
     EVT_BUS_LOCK_ERR = -6,
     EVT_BUS_ALLOC_ERR = -7,
     EVT_BUS_PUB_ERR = -8,
+    EVT_BUS_POOL_ERR = -9,
+    EVT_BUS_NOT_FOUND_ERR = -10,
+    EVT_BUS_TIMER_ERR = -11,
+    EVT_BUS_TRACE_ERR = -12,
+    EVT_BUS_SHM_ERR = -13,
 };
 
 #endif // __EVENT_BUS_ERROR_H__
\ No newline at end of file
@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_HIST_H__
+#define __EVENT_BUS_HIST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "event_bus_dflt_cfg.h"
+
+// log-linear buckets: values below 2^(EB_LAT_HIST_SUB_BITS + 1) are exact,
+// then each power of 2 is split in 2^EB_LAT_HIST_SUB_BITS buckets
+#define EB_LAT_HIST_NB_BUCKETS      ((33 - EB_LAT_HIST_SUB_BITS) << EB_LAT_HIST_SUB_BITS)
+
+// percentiles are given in 1/10000
+#define EB_LAT_P50                  5000
+#define EB_LAT_P99                  9900
+#define EB_LAT_P999                 9990
+
+typedef struct eb_lat_hist_t
+{
+    atomic_uint max;
+    atomic_ullong sum;
+    atomic_uint buckets[EB_LAT_HIST_NB_BUCKETS];
+}eb_lat_hist_t;
+
+typedef struct eb_lat_stats_t
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t mean;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t p999;
+}eb_lat_stats_t;
+
+void eb_lat_hist_add(eb_lat_hist_t *hist, uint32_t value);
+void eb_lat_hist_get(eb_lat_hist_t *hist, eb_lat_stats_t *stats, bool reset);
+void eb_lat_hist_merge(eb_lat_hist_t *const *hists, uint32_t nb, eb_lat_stats_t *stats, bool reset);
+uint32_t eb_lat_hist_percentile(const uint32_t *buckets, uint32_t count, uint32_t pct);
+
+#endif // __EVENT_BUS_HIST_H__
@@ -0,0 +1,44 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_INBOX_H__
+#define __EVENT_BUS_INBOX_H__
+
+#include "event_bus.h"
+
+int32_t eb_inbox_init(eb_inbox_t *inbox, eb_inbox_drop_cb_t *drop, void *drop_ctx);
+int32_t eb_inbox_push(eb_inbox_t *inbox, const eb_msg_t *msg, uint32_t prio, uint32_t policy, uint32_t timeout);
+uint32_t eb_inbox_push_batch(eb_inbox_t *inbox, const eb_msg_t *msgs, uint32_t nb, uint32_t prio);
+int32_t eb_inbox_get(eb_inbox_t *inbox, eb_msg_t *msg, uint32_t timeout);
+uint32_t eb_inbox_depth(eb_inbox_t *inbox, uint32_t prio);
+uint32_t eb_inbox_high_watermark(eb_inbox_t *inbox);
+void eb_inbox_kick(eb_inbox_t *inbox);
+
+#endif // __EVENT_BUS_INBOX_H__
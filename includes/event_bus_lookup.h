@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_LOOKUP_H__
+#define __EVENT_BUS_LOOKUP_H__
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "event_bus_dflt_cfg.h"
+
+#if EB_EVT_LOOKUP == EB_EVT_LOOKUP_HASH
+// load factor is kept at or below 50%
+#define EB_EVT_LOOKUP_SIZE          EB_NEXT_POW2(2 * MAX_NB_EVENTS)
+#elif EB_EVT_LOOKUP == EB_EVT_LOOKUP_DIRECT
+#define EB_EVT_LOOKUP_SIZE          EB_EVT_DIRECT_MAX_ID
+#endif
+
+#ifdef EB_EVT_LOOKUP_SIZE
+typedef struct eb_lookup_slot_t
+{
+    uint32_t id;
+    atomic_uint ref;    // event index + 1, 0 when the slot is free
+}eb_lookup_slot_t;
+
+typedef struct eb_lookup_t
+{
+    eb_lookup_slot_t slots[EB_EVT_LOOKUP_SIZE];
+}eb_lookup_t;
+
+void eb_lookup_init(eb_lookup_t *tbl);
+int32_t eb_lookup_insert(eb_lookup_t *tbl, uint32_t id, uint32_t index);
+int32_t eb_lookup_find(eb_lookup_t *tbl, uint32_t id);
+#endif
+
+#endif // __EVENT_BUS_LOOKUP_H__
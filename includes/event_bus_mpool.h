@@ -0,0 +1,57 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_MPOOL_H__
+#define __EVENT_BUS_MPOOL_H__
+
+#include "event_bus.h"
+
+#define EB_MPOOL_NB_CLASS           3
+
+// room kept in every block on top of its class size for the header of a
+// payload buffer, see event_bus_buf.c. A class holds its nominal payload size
+#define EB_MPOOL_HDR_LEN            8
+
+typedef struct eb_mpool_stats_t
+{
+    uint32_t size;
+    uint32_t count;
+    uint32_t used;
+    uint32_t peak;
+    uint32_t fail;
+}eb_mpool_stats_t;
+
+int32_t eb_mpool_init(void);
+// len counts the EB_MPOOL_HDR_LEN bytes of header
+int32_t eb_mpool_alloc(uint32_t len, void **block);
+void eb_mpool_free(void *block);
+int32_t eb_mpool_get_stats(uint32_t class_id, eb_mpool_stats_t *stats);
+
+#endif // __EVENT_BUS_MPOOL_H__
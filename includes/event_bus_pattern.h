@@ -0,0 +1,72 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_PATTERN_H__
+#define __EVENT_BUS_PATTERN_H__
+
+#include "event_bus.h"
+
+// subscription to the event ids from lo to hi
+typedef struct eb_pat_t
+{
+    uint32_t lo;
+    uint32_t hi;
+    eb_sub_t sub;
+}eb_pat_t;
+
+// ids from lo to hi match the same patterns, subs lists them in
+// subscription order
+typedef struct eb_pat_seg_t
+{
+    uint32_t lo;
+    uint32_t hi;
+    eb_sub_tbl_t *subs;
+}eb_pat_seg_t;
+
+// Match index, immutable once published in eb_t like the subscriber tables.
+// Patterns are compiled into sorted disjoint segments, an event id is
+// matched with a binary search whatever the number of patterns.
+typedef struct eb_pat_idx_t
+{
+    struct eb_pat_idx_t *next;                  // retired indexes
+    uint32_t epoch;                             // bus epoch when retired
+    uint32_t nb_pat;
+    eb_pat_t *pats;
+    uint32_t nb_seg;
+    eb_pat_seg_t *segs;
+}eb_pat_idx_t;
+
+int32_t eb_pat_split(uint32_t value, uint32_t mask, eb_pat_t *pats, uint32_t max);
+eb_pat_idx_t *eb_pat_idx_new(const eb_pat_idx_t *idx, const eb_pat_t *pats, uint32_t nb_pat, eb_sub_cb_t *remove);
+eb_sub_tbl_t *eb_pat_idx_find(const eb_pat_idx_t *idx, uint32_t event_id);
+void eb_pat_idx_retire(eb_t *bus, eb_pat_idx_t *idx);
+void eb_pat_idx_reclaim(eb_t *bus);
+
+#endif // __EVENT_BUS_PATTERN_H__
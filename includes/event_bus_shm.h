@@ -0,0 +1,87 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_SHM_H__
+#define __EVENT_BUS_SHM_H__
+
+#include "event_bus.h"
+
+// Shared memory transport between processes of the same host. A ring is
+// created by the process receiving the events: eb_shm_create maps a
+// shm_open object and starts a thread feeding what it reads to eb_pub_at,
+// remote events then go through the dispatchers like local ones. Other
+// processes attach with eb_shm_open and publish in the ring, several
+// publishers may share it. A process receives from one ring per eb_shm_t
+// and publishes to as many as it opens.
+//
+// Messages are written in place in the ring, the receiver copies the payload
+// once into the message or a pool buffer. eb_shm_alloc and eb_shm_commit let
+// a publisher fill the payload in the ring itself. Both sides sleep on
+// futexes and only make a system call when the other one waits. The
+// receiver checks the length and priority of each message, any process
+// mapping the ring can write it, and drops malformed ones.
+//
+// The ring layout depends on EB_SHM_RING_LEN and EB_SHM_MSG_LEN, processes
+// sharing a ring must be built with the same values. A publisher dying
+// between eb_shm_alloc and eb_shm_commit stalls the ring until it is
+// created again.
+
+#define EB_SHM_MAGIC                0x4D534245U // "EBSM"
+#define EB_SHM_VERSION              1
+
+typedef struct eb_shm_t
+{
+    struct eb_shm_ring_t *ring;
+    eb_t *bus;                                  // receiving bus, NULL on the publishing side
+    eb_thread_t thread;
+    atomic_uint done;                           // futex, set once the thread leaves
+    atomic_bool stop;
+    char name[EB_SHM_NAME_MAX_LEN];
+}eb_shm_t;
+
+// name follows shm_open(), "/eb_gateway" for instance. A ring left by a
+// process that died is replaced
+int32_t eb_shm_create(eb_shm_t *shm, eb_t *bus, const char *name);
+// fails with EVT_BUS_NOT_FOUND_ERR until the ring is created
+int32_t eb_shm_open(eb_shm_t *shm, const char *name);
+// stops the receiving thread and removes the ring name, or detaches a
+// publisher
+void eb_shm_close(eb_shm_t *shm);
+
+// copies up to EB_SHM_MSG_LEN bytes in the ring, waits up to
+// EB_SHM_PUB_TIMEOUT on a full ring
+int32_t eb_shm_pub(eb_shm_t *shm, uint32_t event_id, const void *data, uint32_t len, uint32_t prio);
+// reserve the next slot and fill its payload in place, eb_shm_commit hands
+// it to the receiver. Messages are received in reservation order, a slot
+// reserved must be committed
+int32_t eb_shm_alloc(eb_shm_t *shm, uint32_t len, void **data);
+void eb_shm_commit(eb_shm_t *shm, void *data, uint32_t event_id, uint32_t prio);
+
+#endif // __EVENT_BUS_SHM_H__
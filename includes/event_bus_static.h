@@ -0,0 +1,73 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_STATIC_H__
+#define __EVENT_BUS_STATIC_H__
+
+#include "event_bus.h"
+
+#if EB_USE_STATIC_SUBS
+
+// Subscribers known at build time. EB_STATIC_EVT declares the subscriber
+// table of an event as a const object and registers it in the eb_static_evts
+// linker section. eb_init points the event to the table without copying it,
+// dispatchers and workers use it as any other table. Subscribing, unsubscribing
+// or changing a deadline on the event at runtime switches it to a RAM copy.
+//
+// EB_STATIC_EVT(button, EVT_BUTTON,
+//     EB_STATIC_SUB("led", led_cb, NULL, true),
+//     EB_STATIC_SUB("logger", log_cb, &log_ctx, false));
+typedef struct eb_static_evt_t
+{
+    uint32_t evt_id;
+    const eb_sub_tbl_t *subs;
+}eb_static_evt_t;
+
+#define EB_STATIC_SECTION           "eb_static_evts"
+
+// the table is read-only, its subscribers can't be given a stats id and
+// are only counted in the event and overall histograms
+#define EB_STATIC_SUB(sub_name, sub_cb, sub_arg, sub_direct) \
+    { .name = sub_name, .arg = sub_arg, .direct = sub_direct, .stats_id = EB_STATS_UNTRACKED, .cb = sub_cb }
+
+// sym names the table, an event id is declared once in the whole program
+#define EB_STATIC_EVT(sym, id, ...)                                                 \
+    static const eb_sub_tbl_t eb_static_tbl_##sym = {                               \
+        .ref = EB_SUB_TBL_STATIC,                                                   \
+        .nb_sub = sizeof((eb_sub_t[]){ __VA_ARGS__ }) / sizeof(eb_sub_t),           \
+        .subs = { __VA_ARGS__ },                                                    \
+    };                                                                              \
+    static const eb_static_evt_t eb_static_evt_##sym                                \
+        __attribute__((used, section(EB_STATIC_SECTION), aligned(sizeof(void *)))) = \
+        { .evt_id = (id), .subs = &eb_static_tbl_##sym }
+
+#endif
+
+#endif // __EVENT_BUS_STATIC_H__
@@ -32,25 +32,67 @@
 #define __EVENT_BUS_STATS_H__
 
 #include "event_bus.h"
+#include "event_bus_hist.h"
 
-typedef struct eb_hist_t
+// latencies are recorded in ns, delays longer than 4.29 s wrap around
+enum eb_stats_lat
 {
-    char name[EB_SUB_NAME_MAX_LEN];
-    uint32_t event_id;
-    uint32_t lat;
-}eb_hist_t;
+    EB_STATS_LAT_CB = 0,                        // subscriber callback duration
+    EB_STATS_LAT_QUEUE,                         // publish to dispatch
+    EB_STATS_LAT_HANDOFF,                       // dispatch to worker start
+    EB_STATS_NB_LAT,
+};
+
+// where published payloads are stored
+enum eb_stats_alloc
+{
+    EB_STATS_ALLOC_INLINE = 0,                  // copied in the queued message
+    EB_STATS_ALLOC_POOL,                        // memory pool block
+    EB_STATS_ALLOC_HEAP,                        // eb_malloc fallback
+    EB_STATS_NB_ALLOC,
+};
+
+// Samples go to the shard of the recording thread, picked by
+// eb_thread_index(), and shards are merged when stats are read. Subscribers
+// and event ids are tracked by their index in tables only appended to
+typedef struct eb_stats_shard_t
+{
+    _Alignas(EB_CACHE_LINE) eb_lat_hist_t lat[EB_STATS_NB_LAT];
+    eb_lat_hist_t subs[EB_STATS_NB_SUBS];
+    eb_lat_hist_t evts[EB_STATS_NB_EVTS];
+    atomic_uint alloc[EB_STATS_NB_ALLOC];
+    atomic_ullong lat_max;                      // latency << 32 | subscriber id
+}eb_stats_shard_t;
 
 typedef struct eb_stats_t
 {
-    uint32_t lat_min;
-    uint32_t lat_avg;
-    uint32_t lat_max;
-    uint32_t index;
-    char lat_max_name[EB_SUB_NAME_MAX_LEN];
+    eb_stats_shard_t shards[EB_STATS_NB_SHARDS];
+    atomic_uint nb_sub;
+    char subs[EB_STATS_NB_SUBS][EB_SUB_NAME_MAX_LEN];
+    atomic_uint nb_evt;
+    uint32_t evts[EB_STATS_NB_EVTS];
 }eb_stats_t;
 
+// called for each tracked subscriber (event_id unused) then for each tracked
+// event id (name is NULL)
+typedef void (eb_stats_cb_t)(void *arg, const char *name, uint32_t event_id, const eb_lat_stats_t *stats);
+
 int32_t eb_stats_init(eb_t *bus);
-int32_t eb_stats_add(eb_t *bus, const char *name, uint32_t event_id, uint32_t latency);
+// id of a subscriber name, EB_STATS_UNTRACKED once EB_STATS_NB_SUBS names
+// are tracked
+uint32_t eb_stats_intern(const char *name);
+int32_t eb_stats_add(eb_t *bus, const eb_sub_t *sub, uint32_t event_id, uint32_t latency);
+void eb_stats_add_delay(uint32_t kind, uint32_t delay);
+void eb_stats_add_alloc(uint32_t kind);
+// bus counters, enum eb_stats_cnt
+void eb_stats_count(eb_t *bus, uint32_t kind, uint32_t n);
+void eb_stats_add_busy(eb_t *bus, uint64_t ns);
+uint32_t eb_stats_get_alloc(uint32_t kind, bool reset);
+int32_t eb_stats_get(uint32_t kind, eb_lat_stats_t *stats, bool reset);
+int32_t eb_stats_get_sub(const char *name, eb_lat_stats_t *stats, bool reset);
+int32_t eb_stats_get_evt(uint32_t event_id, eb_lat_stats_t *stats, bool reset);
+void eb_stats_walk(eb_stats_cb_t *cb, void *arg, bool reset);
+void eb_stats_reset(void);
 void eb_stats_print(void);
 
-#endif // __EVENT_BUS_STATS_H__
\ No newline at end of file
+#endif // __EVENT_BUS_STATS_H__
@@ -0,0 +1,56 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_SUBS_H__
+#define __EVENT_BUS_SUBS_H__
+
+#include "event_bus.h"
+
+// Subscriber tables are immutable once published in eb_evt_t. Subscribe and
+// unsubscribe build a new table, swap it in and retire the old one, the
+// dispatchers free retired tables between two batches, once none of them
+// can hold a pointer to them anymore. Workers keep a reference on the table
+// of the event they handle. Static tables (EB_SUB_TBL_STATIC) are never
+// counted, retired nor freed.
+eb_sub_tbl_t *eb_sub_tbl_new(const eb_sub_tbl_t *tbl, uint32_t nb_sub);
+void eb_sub_tbl_ref(eb_sub_tbl_t *tbl);
+void eb_sub_tbl_release(eb_sub_tbl_t *tbl);
+void eb_sub_tbl_retire(eb_t *bus, eb_sub_tbl_t *tbl);
+void eb_sub_tbl_reclaim(eb_t *bus);
+
+// A dispatcher publishes the bus epoch it saw before loading any table and
+// clears it after its batch. A table retired at a given epoch is freed when
+// every dispatcher is between batches or started its batch later.
+void eb_epoch_enter(eb_shard_t *shard);
+void eb_epoch_exit(eb_shard_t *shard);
+uint32_t eb_epoch_retire(eb_t *bus);
+bool eb_epoch_passed(eb_t *bus, uint32_t epoch);
+
+#endif // __EVENT_BUS_SUBS_H__
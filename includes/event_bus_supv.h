@@ -34,7 +34,12 @@
 #include "event_bus.h"
 #include "event_bus_worker.h"
 
-void eb_supv_start(eb_worker_t *worker);
-void eb_supv_run(void);
+// Subscribers run by workers are given a deadline, the supervisor thread
+// keeps the running ones in a min-heap and sleeps until the earliest one.
+// A subscriber still running past its deadline gets its worker cancelled
+// and the remaining subscribers are deferred to another worker.
+int32_t eb_supv_init(void);
+void eb_supv_start(eb_worker_t *worker, uint32_t deadline_ms);
+void eb_supv_stop(eb_worker_t *worker);
 
 #endif // __EVENT_SUPERVISOR_H__
\ No newline at end of file
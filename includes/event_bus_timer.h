@@ -0,0 +1,61 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_TIMER_H__
+#define __EVENT_BUS_TIMER_H__
+
+#include "event_bus.h"
+
+#if EB_MAX_TIMERS > 0
+
+#if EB_TIMER_WHEEL_BITS > 6 || EB_TIMER_LEVELS * EB_TIMER_WHEEL_BITS > 31
+#error "timer wheel too big, check EB_TIMER_WHEEL_BITS and EB_TIMER_LEVELS"
+#endif
+
+// Timers are linked in the wheel of the range of their delay and move down
+// a wheel each time the lower one wraps around, insert and cancel are O(1).
+// The first dispatcher runs the wheel between two batches and sleeps until
+// the next slot holding a timer, adding an earlier timer kicks it.
+
+// called with the wheel locked, it must not wait for room in an inbox. The
+// timer keeps its payload, the callback takes its own reference
+typedef void (eb_timer_fire_cb_t)(void *ctx, eb_timer_t *timer);
+
+int32_t eb_timer_init(eb_timers_t *timers);
+// takes ownership of data, true in kick when the dispatcher must wake up
+int32_t eb_timer_add(eb_timers_t *timers, uint32_t evt_id, void *data, uint32_t len, uint32_t prio,
+    uint32_t delay_ms, uint32_t period_ms, eb_timer_id_t *id, bool *kick);
+int32_t eb_timer_del(eb_timers_t *timers, eb_timer_id_t id);
+// fires the due timers, returns the ms until the next one or EB_WAIT_FOREVER
+uint32_t eb_timer_run(eb_timers_t *timers, eb_timer_fire_cb_t *fire, void *ctx);
+
+#endif
+
+#endif // __EVENT_BUS_TIMER_H__
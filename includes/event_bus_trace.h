@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#ifndef __EVENT_BUS_TRACE_H__
+#define __EVENT_BUS_TRACE_H__
+
+#include "event_bus.h"
+
+// Every stage of a message is recorded as a fixed size record in the ring of
+// the calling thread, rings are picked by eb_thread_index(). Recording is
+// lock free and safe when threads share a ring: a slot is reserved with an
+// atomic increment and stamped once written, eb_trace_dump skips the slots
+// being written. Old records are overwritten, a ring keeps the last
+// EB_TRACE_DEPTH ones.
+//
+// A dump is an eb_trace_hdr_t followed by eb_trace_rec_t records in host
+// byte order, grouped by ring. tools/eb_trace2json.py converts it to the
+// Chrome trace format read by Perfetto and chrome://tracing.
+
+#define EB_TRACE_MAGIC              0x52544245U // "EBTR"
+#define EB_TRACE_VERSION            1
+
+enum eb_trace_stage
+{
+    EB_TRACE_PUB = 0,                           // publish call, arg: priority
+    EB_TRACE_ENQUEUE,                           // queued in an inbox, arg: dispatcher
+    EB_TRACE_REJECT,                            // publish failed, arg: dispatcher
+    EB_TRACE_DEQUEUE,                           // taken by a dispatcher, arg: dispatcher
+    EB_TRACE_POST,                              // handed to a worker, arg: worker
+    EB_TRACE_CB_START,                          // subscriber called, name set
+    EB_TRACE_CB_END,                            // subscriber returned, name set
+    EB_TRACE_TIMEOUT,                           // subscriber past its deadline, arg: worker
+    EB_TRACE_DEFER,                             // remaining subscribers posted again, arg: first one
+    EB_TRACE_NB_STAGES,
+};
+
+typedef struct eb_trace_hdr_t
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size;                          // sizeof(eb_trace_rec_t)
+}eb_trace_hdr_t;
+
+typedef struct eb_trace_rec_t
+{
+    uint64_t ts;                                // eb_get_time_ns()
+    uint32_t evt_id;
+    uint32_t key;                               // pub_ns of the message, the same at every stage
+    uint32_t len;                               // payload length
+    uint16_t thread;                            // eb_thread_index() of the recording thread
+    uint8_t stage;                              // enum eb_trace_stage
+    uint8_t arg;
+    char name[8];                               // subscriber name, may not be terminated
+}eb_trace_rec_t;
+
+// returns 0 once len bytes are written
+typedef int32_t (eb_trace_write_cb_t)(void *ctx, const void *data, uint32_t len);
+
+#if EB_USE_TRACE
+#define eb_trace(stage, evt_id, key, len, arg, name)    eb_trace_rec(stage, evt_id, key, len, arg, name)
+#else
+#define eb_trace(stage, evt_id, key, len, arg, name)
+#endif
+
+void eb_trace_rec(uint8_t stage, uint32_t evt_id, uint32_t key, uint32_t len, uint32_t arg, const char *name);
+// recording is enabled at start up
+void eb_trace_enable(bool enable);
+void eb_trace_reset(void);
+// can run while recording, returns the number of records written or a
+// negative error
+int32_t eb_trace_dump(eb_trace_write_cb_t *write, void *ctx);
+
+#endif // __EVENT_BUS_TRACE_H__
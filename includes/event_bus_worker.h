@@ -33,23 +33,40 @@
 
 #include "event_bus.h"
 
+typedef struct eb_work_t
+{
+    eb_t *bus;
+    eb_msg_t msg;
+    uint32_t index;
+    uint32_t post_ns;                           // low 32 bits of eb_get_time_ns()
+}eb_work_t;
+
 typedef struct eb_worker_t
 {
     char name[EB_WORKER_MAX_NAME_LEN];
     eb_t *bus;
     eb_msg_t msg;
     eb_thread_t thread;
-    eb_queue_t queue;
-    uint32_t start_time;
+    eb_mutex_t lock;
+    eb_sem_t wake;
+    eb_work_t mailbox[EB_WORKER_QUEUE_LEN];
+    uint32_t head;
+    atomic_uint count;                          // written under lock, read without it
+    atomic_uint idle;
+    uint32_t deadline;                          // tick, see event_bus_supv.h
+    int32_t heap_pos;                           // -1 when not supervised
     uint32_t index;
+    uint32_t id;
     bool running;
     bool cancelled;
-    bool timer_enabled;
 }eb_worker_t;
 
-int32_t eb_worker_init(eb_t *bus);
-int32_t eb_worker_exec(eb_t *bus, eb_sub_t *sub, uint32_t event_id, void *data, uint32_t len);
-int32_t eb_worker_post(eb_t *bus, eb_evt_t *evt, uint8_t index, void *data, uint32_t len);
-void eb_worker_timeout(eb_worker_t *worker);
+int32_t eb_worker_init(eb_t *bus, uint32_t nb_workers, const uint32_t *affinity);
+int32_t eb_worker_exec(eb_t *bus, eb_sub_t *sub, eb_msg_t *msg);
+int32_t eb_worker_post(eb_t *bus, eb_msg_t *msg, uint8_t index, uint32_t timeout);
+void eb_worker_cancel(eb_worker_t *worker, eb_work_t *work);
+void eb_worker_timeout(eb_worker_t *worker, eb_work_t *work);
+eb_worker_t *eb_worker_get_list(void);
+uint32_t eb_worker_get_count(void);
 
-#endif
\ No newline at end of file
+#endif
@@ -31,6 +31,8 @@
 #include "eb_port.h"
 #include "event_bus.h"
 
+#define EB_TIMEOUT_TICKS(ms)        ((ms) == EB_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(ms))
+
 int32_t eb_mutex_new(eb_mutex_t *mutex)
 {
     *mutex = xSemaphoreCreateMutex();
@@ -49,7 +51,7 @@ int32_t eb_mutex_take(eb_mutex_t *mutex, uint32_t timeout)
             return 0;
         }
     }else{
-        if(xSemaphoreTake(*mutex, timeout) == pdTRUE){
+        if(xSemaphoreTake(*mutex, EB_TIMEOUT_TICKS(timeout)) == pdTRUE){
    		    return 0;
         }
     }
@@ -64,6 +66,39 @@ int32_t eb_mutex_give(eb_mutex_t *mutex)
     return 0;
 }
 
+int32_t eb_sem_new(eb_sem_t *sem)
+{
+    *sem = xSemaphoreCreateBinary();
+
+    if(*sem == NULL)
+        return -1;
+
+    return 0;
+}
+
+int32_t eb_sem_take(eb_sem_t *sem, uint32_t timeout)
+{
+    if(xSemaphoreTake(*sem, EB_TIMEOUT_TICKS(timeout)) == pdTRUE){
+        return 0;
+    }
+
+    return -1;
+}
+
+int32_t eb_sem_give(eb_sem_t *sem)
+{
+    BaseType_t woken = pdFALSE;
+
+    if(mcu_in_isr){
+        xSemaphoreGiveFromISR(*sem, &woken);
+        portYIELD_FROM_ISR(woken);
+    }else{
+        xSemaphoreGive(*sem);
+    }
+
+    return 0;
+}
+
 int32_t eb_queue_new(eb_queue_t *queue, uint32_t item_size, uint32_t length)
 {
     *queue = xQueueCreate(length, item_size);
@@ -78,21 +113,21 @@ int32_t eb_queue_push(eb_queue_t *queue, const void *item, uint32_t prio, uint32
 {
     if(prio == EVENT_BUS_HIGH_PRIO){
         if(mcu_in_isr){
-            if(xQueueSendToFront(*queue, item, timeout) == pdTRUE){
+            if(xQueueSendToFrontFromISR(*queue, item, NULL) == pdTRUE){
                 return 0;
             }
         }else{
-            if(xQueueSendToFrontFromISR(*queue, item, NULL) == pdTRUE){
+            if(xQueueSendToFront(*queue, item, EB_TIMEOUT_TICKS(timeout)) == pdTRUE){
                 return 0;
             }
         }
     }else{
         if(mcu_in_isr){
-            if(xQueueSendToBack(*queue, item, timeout) == pdTRUE){
+            if(xQueueSendToBackFromISR(*queue, item, NULL) == pdTRUE){
                 return 0;
             }
         }else{
-            if(xQueueSendToBackFromISR(*queue, item, NULL) == pdTRUE){
+            if(xQueueSendToBack(*queue, item, EB_TIMEOUT_TICKS(timeout)) == pdTRUE){
                 return 0;
             }
         }
@@ -100,9 +135,29 @@ int32_t eb_queue_push(eb_queue_t *queue, const void *item, uint32_t prio, uint32
     return -1;
 }
 
+uint32_t eb_queue_push_batch(eb_queue_t *queue, const void *items, uint32_t count, uint32_t prio, uint32_t timeout)
+{
+    uint32_t i;
+    UBaseType_t item_size = uxQueueGetQueueItemSize(*queue);
+
+    // FreeRTOS has no multi-item send, items are queued one by one
+    for(i = 0 ; i < count ; i++){
+        if(eb_queue_push(queue, (const uint8_t *)items + i * item_size, prio, timeout)){
+            break;
+        }
+    }
+
+    return i;
+}
+
 int32_t eb_queue_get(eb_queue_t *queue, void *item, uint32_t timeout)
 {
-    if(xQueueReceive(*queue, item, timeout) == pdPASS){
+    // publishers evicting a message may run from an ISR
+    if(mcu_in_isr){
+        if(xQueueReceiveFromISR(*queue, item, NULL) == pdPASS){
+            return 0;
+        }
+    }else if(xQueueReceive(*queue, item, EB_TIMEOUT_TICKS(timeout)) == pdPASS){
         return 0;
     }
     return -1;
@@ -110,8 +165,9 @@ int32_t eb_queue_get(eb_queue_t *queue, void *item, uint32_t timeout)
 
 int32_t eb_queue_delete(eb_queue_t *queue)
 {
-    if(queue){
-        vQueueDelete(queue);
+    if(queue && *queue){
+        vQueueDelete(*queue);
+        *queue = NULL;
     }
     return 0;
 }
@@ -133,11 +189,110 @@ void eb_thread_delete(eb_thread_t thread)
     vTaskDelete(thread);
 }
 
+// needs an SMP kernel built with configUSE_CORE_AFFINITY
+int32_t eb_thread_set_affinity(eb_thread_t thread, uint32_t mask)
+{
+#if (configUSE_CORE_AFFINITY == 1) && (configNUMBER_OF_CORES > 1)
+    if(mask != 0){
+        vTaskCoreAffinitySet(thread, (UBaseType_t)mask);
+    }
+    return 0;
+#else
+    (void)thread;
+    return mask != 0 ? -1 : 0;
+#endif
+}
+
+// every task shares index 0 without a free thread local storage pointer,
+// interrupts share index 0 as well
+uint32_t eb_thread_index(void)
+{
+#if configNUM_THREAD_LOCAL_STORAGE_POINTERS > EB_TLS_INDEX
+    static atomic_uint next = 0;
+    uintptr_t index;
+
+    if(mcu_in_isr){
+        return 0;
+    }
+
+    index = (uintptr_t)pvTaskGetThreadLocalStoragePointer(NULL, EB_TLS_INDEX);
+    if(index == 0){
+        index = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed) + 1;
+        vTaskSetThreadLocalStoragePointer(NULL, EB_TLS_INDEX, (void *)index);
+    }
+
+    return (uint32_t)(index - 1);
+#else
+    return 0;
+#endif
+}
+
 uint32_t eb_get_tick(void)
 {
     return xTaskGetTickCount();
 }
 
+#if EB_USE_DWT
+#define EB_DWT_CTRL                 (*(volatile uint32_t *)0xE0001000)
+#define EB_DWT_CYCCNT               (*(volatile uint32_t *)0xE0001004)
+#define EB_DEMCR                    (*(volatile uint32_t *)0xE000EDFC)
+#define EB_DEMCR_TRCENA             (1UL << 24)
+#define EB_DWT_CYCCNTENA            (1UL << 0)
+
+// CYCCNT is 32 bits, it is extended here and must be read at least once per
+// wrap (about 25 s at 168 MHz). A wrap missed while the bus is idle only
+// shifts the absolute time, latencies are measured between close reads
+uint64_t eb_get_time_ns(void)
+{
+    static uint32_t last = 0;
+    static uint64_t high = 0;
+    uint32_t state;
+    uint32_t cyc;
+    uint64_t cycles;
+
+    state = eb_enter_critical();
+    if(!(EB_DWT_CTRL & EB_DWT_CYCCNTENA)){
+        EB_DEMCR |= EB_DEMCR_TRCENA;
+        EB_DWT_CYCCNT = 0;
+        EB_DWT_CTRL |= EB_DWT_CYCCNTENA;
+    }
+
+    cyc = EB_DWT_CYCCNT;
+    if(cyc < last){
+        high += 1ULL << 32;
+    }
+    last = cyc;
+    cycles = high | cyc;
+    eb_exit_critical(state);
+
+    return (cycles / configCPU_CLOCK_HZ) * 1000000000ULL + ((cycles % configCPU_CLOCK_HZ) * 1000000000ULL) / configCPU_CLOCK_HZ;
+}
+#else
+uint64_t eb_get_time_ns(void)
+{
+    return (uint64_t)xTaskGetTickCount() * portTICK_PERIOD_MS * 1000000ULL;
+}
+#endif
+
+uint32_t eb_enter_critical(void)
+{
+    if(mcu_in_isr){
+        return taskENTER_CRITICAL_FROM_ISR();
+    }
+
+    taskENTER_CRITICAL();
+    return 0;
+}
+
+void eb_exit_critical(uint32_t state)
+{
+    if(mcu_in_isr){
+        taskEXIT_CRITICAL_FROM_ISR(state);
+    }else{
+        taskEXIT_CRITICAL();
+    }
+}
+
 void *eb_malloc(size_t len)
 {
     return pvPortMalloc(len);
@@ -43,14 +43,50 @@
 #define EB_WORKER_STACK_SIZE        (configMINIMAL_STACK_SIZE * 4)
 #define EB_WORKER_PRIO              (tskIDLE_PRIORITY + 1)
 
+#define EB_MS_TO_TICK(ms)           pdMS_TO_TICKS(ms)
+#define EB_TICK_TO_MS(tick)         ((uint32_t)(tick) * portTICK_PERIOD_MS)
+
+// thread local storage pointer holding eb_thread_index(), needs
+// configNUM_THREAD_LOCAL_STORAGE_POINTERS above it
+#ifndef EB_TLS_INDEX
+#define EB_TLS_INDEX                0
+#endif
+
 typedef QueueHandle_t eb_queue_t;
 typedef SemaphoreHandle_t eb_mutex_t;
 typedef TaskHandle_t eb_thread_t;
+typedef SemaphoreHandle_t eb_sem_t;
+
+#elif defined(USE_POSIX)
+#include <stdint.h>
+#include <stddef.h>
+
+// stack sizes are in bytes, priorities are ignored unless the process runs
+// with a real-time scheduling policy
+#define EB_STACK_SIZE               (64 * 1024)
+#define EB_PRIO                     (0)
+#define EB_WORKER_STACK_SIZE        (64 * 1024)
+#define EB_WORKER_PRIO              (0)
+
+// eb_get_tick() runs at 1MHz on POSIX hosts
+#define EB_MS_TO_TICK(ms)           ((uint32_t)(ms) * 1000U)
+#define EB_TICK_TO_MS(tick)         (((uint32_t)(tick) + 999U) / 1000U)
+
+typedef struct eb_posix_queue *eb_queue_t;
+typedef struct eb_posix_mutex *eb_mutex_t;
+typedef struct eb_posix_thread *eb_thread_t;
+typedef struct eb_posix_sem *eb_sem_t;
 
 #endif
 
+// All timeouts passed to the port layer are expressed in milliseconds, tick
+// values returned by eb_get_tick() must be converted with EB_MS_TO_TICK()
+#define EB_WAIT_FOREVER             (0xFFFFFFFFU)
+
 int32_t eb_queue_new(eb_queue_t *queue, uint32_t item_size, uint32_t length);
 int32_t eb_queue_push(eb_queue_t *queue, const void *item, uint32_t prio, uint32_t timeout);
+// push up to count items, returns the number of items queued
+uint32_t eb_queue_push_batch(eb_queue_t *queue, const void *items, uint32_t count, uint32_t prio, uint32_t timeout);
 int32_t eb_queue_get(eb_queue_t *queue, void *item, uint32_t timeout);
 int32_t eb_queue_delete(eb_queue_t *queue);
 
@@ -58,10 +94,28 @@ int32_t eb_mutex_new(eb_mutex_t *mutex);
 int32_t eb_mutex_take(eb_mutex_t *mutex, uint32_t timeout);
 int32_t eb_mutex_give(eb_mutex_t *mutex);
 
+// binary semaphore, eb_sem_give can be called from ISRs
+int32_t eb_sem_new(eb_sem_t *sem);
+int32_t eb_sem_take(eb_sem_t *sem, uint32_t timeout);
+int32_t eb_sem_give(eb_sem_t *sem);
+
 eb_thread_t eb_thread_new(const char *name, void (*thread)(void *arg), void *arg, int stack_size, int prio);
 void eb_thread_delete(eb_thread_t thread);
+// bit n of mask allows core n, 0 leaves the thread to the scheduler. Fails
+// on targets that can't pin threads
+int32_t eb_thread_set_affinity(eb_thread_t thread, uint32_t mask);
+// small index of the calling thread, handed out on first call and never
+// reused. Threads may share an index on targets without thread local storage
+uint32_t eb_thread_index(void);
 
 uint32_t eb_get_tick(void);
+// monotonic time in ns for latency statistics, finer than the tick when the
+// target has a cycle counter
+uint64_t eb_get_time_ns(void);
+
+// short critical section usable from threads and ISRs, must not block
+uint32_t eb_enter_critical(void);
+void eb_exit_critical(uint32_t state);
 
 void *eb_malloc(size_t len);
 void eb_free(void *pmem);
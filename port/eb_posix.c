@@ -0,0 +1,477 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "eb_port.h"
+#include "event_bus.h"
+
+static pthread_mutex_t eb_posix_crit = PTHREAD_MUTEX_INITIALIZER;
+
+struct eb_posix_mutex
+{
+    pthread_mutex_t lock;
+};
+
+struct eb_posix_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *items;
+    uint32_t item_size;
+    uint32_t length;
+    uint32_t head;
+    uint32_t count;
+};
+
+struct eb_posix_sem
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool given;
+};
+
+struct eb_posix_thread
+{
+    pthread_t id;
+    void (*entry)(void *arg);
+    void *arg;
+};
+
+static void eb_posix_deadline(struct timespec *ts, uint32_t timeout)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout / 1000;
+    ts->tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if(ts->tv_nsec >= 1000000000L){
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static int eb_posix_wait(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline, uint32_t timeout)
+{
+    if(timeout == 0){
+        return ETIMEDOUT;
+    }
+
+    if(timeout == EB_WAIT_FOREVER){
+        return pthread_cond_wait(cond, lock);
+    }
+
+    return pthread_cond_timedwait(cond, lock, deadline);
+}
+
+int32_t eb_mutex_new(eb_mutex_t *mutex)
+{
+    *mutex = malloc(sizeof(struct eb_posix_mutex));
+
+    if(*mutex == NULL)
+        return -1;
+
+    if(pthread_mutex_init(&(*mutex)->lock, NULL)){
+        free(*mutex);
+        *mutex = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t eb_mutex_take(eb_mutex_t *mutex, uint32_t timeout)
+{
+    struct timespec ts;
+
+    if(timeout == 0){
+        return pthread_mutex_trylock(&(*mutex)->lock) ? -1 : 0;
+    }
+
+    // pthread_mutex_timedlock only accepts CLOCK_REALTIME deadlines
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout / 1000;
+    ts.tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if(ts.tv_nsec >= 1000000000L){
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    if(pthread_mutex_timedlock(&(*mutex)->lock, &ts)){
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t eb_mutex_give(eb_mutex_t *mutex)
+{
+    pthread_mutex_unlock(&(*mutex)->lock);
+
+    return 0;
+}
+
+int32_t eb_sem_new(eb_sem_t *sem)
+{
+    struct eb_posix_sem *sm;
+    pthread_condattr_t attr;
+
+    sm = calloc(1, sizeof(struct eb_posix_sem));
+    if(sm == NULL)
+        return -1;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&sm->lock, NULL);
+    pthread_cond_init(&sm->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    *sem = sm;
+    return 0;
+}
+
+int32_t eb_sem_take(eb_sem_t *sem, uint32_t timeout)
+{
+    struct eb_posix_sem *sm = *sem;
+    struct timespec ts;
+
+    eb_posix_deadline(&ts, timeout);
+    pthread_mutex_lock(&sm->lock);
+
+    while(!sm->given){
+        if(eb_posix_wait(&sm->cond, &sm->lock, &ts, timeout) == ETIMEDOUT && !sm->given){
+            pthread_mutex_unlock(&sm->lock);
+            return -1;
+        }
+    }
+    sm->given = false;
+
+    pthread_mutex_unlock(&sm->lock);
+    return 0;
+}
+
+int32_t eb_sem_give(eb_sem_t *sem)
+{
+    struct eb_posix_sem *sm = *sem;
+
+    pthread_mutex_lock(&sm->lock);
+    sm->given = true;
+    pthread_cond_signal(&sm->cond);
+    pthread_mutex_unlock(&sm->lock);
+
+    return 0;
+}
+
+int32_t eb_queue_new(eb_queue_t *queue, uint32_t item_size, uint32_t length)
+{
+    struct eb_posix_queue *q;
+    pthread_condattr_t attr;
+
+    q = calloc(1, sizeof(struct eb_posix_queue));
+    if(q == NULL)
+        return -1;
+
+    q->items = malloc((size_t)item_size * length);
+    if(q->items == NULL){
+        free(q);
+        return -1;
+    }
+
+    q->item_size = item_size;
+    q->length = length;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, &attr);
+    pthread_cond_init(&q->not_full, &attr);
+    pthread_condattr_destroy(&attr);
+
+    *queue = q;
+    return 0;
+}
+
+int32_t eb_queue_push(eb_queue_t *queue, const void *item, uint32_t prio, uint32_t timeout)
+{
+    struct eb_posix_queue *q = *queue;
+    struct timespec ts;
+    uint32_t slot;
+
+    eb_posix_deadline(&ts, timeout);
+    pthread_mutex_lock(&q->lock);
+
+    while(q->count == q->length){
+        if(eb_posix_wait(&q->not_full, &q->lock, &ts, timeout) == ETIMEDOUT && q->count == q->length){
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+    }
+
+    if(prio == EVENT_BUS_HIGH_PRIO){
+        q->head = (q->head + q->length - 1) % q->length;
+        slot = q->head;
+    }else{
+        slot = (q->head + q->count) % q->length;
+    }
+
+    memcpy(&q->items[(size_t)slot * q->item_size], item, q->item_size);
+    q->count++;
+
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+
+    return 0;
+}
+
+uint32_t eb_queue_push_batch(eb_queue_t *queue, const void *items, uint32_t count, uint32_t prio, uint32_t timeout)
+{
+    struct eb_posix_queue *q = *queue;
+    struct timespec ts;
+    uint32_t slot;
+    uint32_t i = 0;
+
+    eb_posix_deadline(&ts, timeout);
+    pthread_mutex_lock(&q->lock);
+
+    while(i < count){
+        while(q->count == q->length){
+            if(eb_posix_wait(&q->not_full, &q->lock, &ts, timeout) == ETIMEDOUT && q->count == q->length){
+                goto exit;
+            }
+        }
+
+        if(prio == EVENT_BUS_HIGH_PRIO){
+            q->head = (q->head + q->length - 1) % q->length;
+            slot = q->head;
+        }else{
+            slot = (q->head + q->count) % q->length;
+        }
+
+        memcpy(&q->items[(size_t)slot * q->item_size], (const uint8_t *)items + (size_t)i * q->item_size, q->item_size);
+        q->count++;
+        i++;
+    }
+
+exit:
+    if(i > 0){
+        pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return i;
+}
+
+int32_t eb_queue_get(eb_queue_t *queue, void *item, uint32_t timeout)
+{
+    struct eb_posix_queue *q = *queue;
+    struct timespec ts;
+
+    eb_posix_deadline(&ts, timeout);
+    pthread_mutex_lock(&q->lock);
+
+    while(q->count == 0){
+        if(eb_posix_wait(&q->not_empty, &q->lock, &ts, timeout) == ETIMEDOUT && q->count == 0){
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+    }
+
+    memcpy(item, &q->items[(size_t)q->head * q->item_size], q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+
+    return 0;
+}
+
+int32_t eb_queue_delete(eb_queue_t *queue)
+{
+    struct eb_posix_queue *q;
+
+    if(queue && *queue){
+        q = *queue;
+        pthread_cond_destroy(&q->not_empty);
+        pthread_cond_destroy(&q->not_full);
+        pthread_mutex_destroy(&q->lock);
+        free(q->items);
+        free(q);
+        *queue = NULL;
+    }
+    return 0;
+}
+
+static void *eb_posix_thread_entry(void *arg)
+{
+    struct eb_posix_thread *th = (struct eb_posix_thread *)arg;
+
+    th->entry(th->arg);
+
+    return NULL;
+}
+
+eb_thread_t eb_thread_new(const char *name, void (*thread)(void *arg), void *arg, int stack_size, int prio)
+{
+    struct eb_posix_thread *th;
+    pthread_attr_t attr;
+    char th_name[16];
+
+    (void)prio;
+
+    th = calloc(1, sizeof(struct eb_posix_thread));
+    if(th == NULL){
+        return NULL;
+    }
+
+    th->entry = thread;
+    th->arg = arg;
+
+    pthread_attr_init(&attr);
+    if(stack_size > 0){
+        pthread_attr_setstacksize(&attr, (size_t)stack_size);
+    }
+
+    if(pthread_create(&th->id, &attr, eb_posix_thread_entry, th)){
+        pthread_attr_destroy(&attr);
+        free(th);
+        return NULL;
+    }
+    pthread_attr_destroy(&attr);
+
+    // linux limits thread names to 15 characters
+    strncpy(th_name, name, sizeof(th_name) - 1);
+    th_name[sizeof(th_name) - 1] = '\0';
+    pthread_setname_np(th->id, th_name);
+
+    return th;
+}
+
+void eb_thread_delete(eb_thread_t thread)
+{
+    if(thread == NULL){
+        return;
+    }
+
+    if(pthread_equal(thread->id, pthread_self())){
+        free(thread);
+        pthread_exit(NULL);
+    }
+
+    pthread_cancel(thread->id);
+    pthread_join(thread->id, NULL);
+    free(thread);
+}
+
+int32_t eb_thread_set_affinity(eb_thread_t thread, uint32_t mask)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    uint32_t i;
+
+    if(thread == NULL){
+        return -1;
+    }
+
+    if(mask == 0){
+        return 0;
+    }
+
+    CPU_ZERO(&set);
+    for(i = 0 ; i < 32 ; i++){
+        if(mask & (1U << i)){
+            CPU_SET(i, &set);
+        }
+    }
+
+    return pthread_setaffinity_np(thread->id, sizeof(set), &set) ? -1 : 0;
+#else
+    (void)thread;
+    return mask != 0 ? -1 : 0;
+#endif
+}
+
+uint32_t eb_thread_index(void)
+{
+    static atomic_uint next = 0;
+    static _Thread_local uint32_t index = 0;
+
+    // 0 until the first call of the thread
+    if(index == 0){
+        index = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed) + 1;
+    }
+
+    return index - 1;
+}
+
+uint32_t eb_get_tick(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL);
+}
+
+uint64_t eb_get_time_ns(void)
+{
+    struct timespec ts;
+
+    // vDSO call, no syscall on Linux and it does not drift across cores
+    // like a raw rdtsc would
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t eb_enter_critical(void)
+{
+    pthread_mutex_lock(&eb_posix_crit);
+
+    return 0;
+}
+
+void eb_exit_critical(uint32_t state)
+{
+    (void)state;
+    pthread_mutex_unlock(&eb_posix_crit);
+}
+
+void *eb_malloc(size_t len)
+{
+    return malloc(len);
+}
+
+void eb_free(void *pmem)
+{
+    free(pmem);
+}
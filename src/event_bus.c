@@ -31,11 +31,28 @@
 #include "event_bus.h"
 #include "event_bus_worker.h"
 #include "event_bus_stats.h"
+#include "event_bus_mpool.h"
+#include "event_bus_buf.h"
+#include "event_bus_subs.h"
+#include "event_bus_pattern.h"
+#include "event_bus_inbox.h"
+#include "event_bus_static.h"
+#include "event_bus_timer.h"
+#include "event_bus_trace.h"
+
+#if EB_USE_STATIC_SUBS
+// set by the linker, weak so that a program without static table links
+extern const eb_static_evt_t __start_eb_static_evts[] __attribute__((weak));
+extern const eb_static_evt_t __stop_eb_static_evts[] __attribute__((weak));
+#endif
 
 static eb_evt_t *eb_get_event(eb_t *bus, uint32_t event_id);
-static bool eb_has_indirect_sub(eb_t *bus, eb_evt_t *evt);
-static int32_t eb_publish_direct(eb_t *bus, eb_evt_t *evt, void *data, uint32_t len);
-static int32_t eb_publish_all(eb_t *bus, eb_evt_t *evt, uint32_t event_id, void *data, uint32_t len);
+static bool eb_has_indirect_sub(eb_t *bus, eb_sub_tbl_t *subs);
+static int32_t eb_publish_direct(eb_t *bus, eb_sub_tbl_t *subs, eb_msg_t *msg);
+static int32_t eb_publish_all(eb_t *bus, eb_msg_t *msg);
+#if EB_MAX_TIMERS > 0
+static void eb_timer_fire(void *ctx, eb_timer_t *timer);
+#endif
 
 static int32_t eb_lock(eb_t *bus)
 {
@@ -53,34 +70,174 @@ static int32_t eb_unlock(eb_t *bus)
     return 0;
 }
 
+static void eb_dispatch(eb_t *bus, eb_sub_tbl_t *subs, eb_sub_tbl_t *psubs, eb_msg_t *msg)
+{
+    msg->subs = subs;
+    msg->psubs = psubs;
+
+    // the worker takes its own reference on the payload and on the
+    // subscriber tables, they are shared with the direct subscribers
+    if(bus->all_sub.cb != NULL && !bus->all_sub.direct){
+        eb_worker_post(bus, msg, 0, EB_WORKER_POST_TIMEOUT);
+    }else if(eb_has_indirect_sub(bus, subs) || eb_has_indirect_sub(bus, psubs)){
+        eb_worker_post(bus, msg, 0, EB_WORKER_POST_TIMEOUT);
+    }
+
+    if(subs != NULL){
+        eb_publish_direct(bus, subs, msg); 
+    }
+
+    if(psubs != NULL){
+        eb_publish_direct(bus, psubs, msg); 
+    }
+
+    eb_publish_all(bus, msg);
+    eb_msg_release(msg);
+}
+
+// a newer payload replaces the pending one, false when no message of the
+// event is queued
+static bool eb_conflate_merge(eb_evt_t *evt, void *data)
+{
+    void *old;
+
+    old = atomic_exchange_explicit(&evt->latest, data, memory_order_acq_rel);
+    if(old == NULL){
+        return false;
+    }
+
+    eb_buf_release(old);
+    atomic_fetch_add_explicit(&evt->merged, 1, memory_order_relaxed);
+    return true;
+}
+
+// an earlier message may have taken the payload already
+static bool eb_conflate_take(eb_evt_t *evt, eb_msg_t *msg)
+{
+    if(evt == NULL){
+        return false;
+    }
+
+    msg->data = atomic_exchange_explicit(&evt->latest, NULL, memory_order_acq_rel);
+    msg->len = eb_buf_len(msg->data);
+
+    return msg->data != NULL;
+}
+
+// evicted from the inbox by a drop policy
+static void eb_drop(void *ctx, eb_msg_t *msg)
+{
+    eb_t *bus = (eb_t *)ctx;
+    eb_evt_t *evt = eb_get_event(bus, msg->evt_id);
+
+    if(msg->flags & EB_MSG_CONFLATED){
+        // the pending payload goes with the only queued message
+        if(evt != NULL){
+            eb_buf_release(atomic_exchange_explicit(&evt->latest, NULL, memory_order_acq_rel));
+        }
+    }else{
+        eb_msg_release(msg);
+    }
+
+    atomic_fetch_add_explicit(&bus->dropped, 1, memory_order_relaxed);
+    if(evt != NULL){
+        atomic_fetch_add_explicit(&evt->dropped, 1, memory_order_relaxed);
+    }
+}
+
 static void eb_thread(void *arg)
 {
-    eb_t *bus = (eb_t *)arg;
+    eb_shard_t *shard = (eb_shard_t *)arg;
+    eb_t *bus = shard->bus;
     eb_evt_t *evt;
-    eb_sub_t *sub;
-    eb_msg_t msg;
+    eb_sub_tbl_t *subs;
+    eb_sub_tbl_t *psubs;
+    eb_pat_idx_t *patterns;
+    eb_msg_t msgs[EB_DISPATCH_BATCH];
+    bool done[EB_DISPATCH_BATCH];
+    uint32_t nb;
+    uint32_t i;
+    uint32_t j;
+    uint32_t now;
+    uint32_t dispatched;
+    uint32_t timeout = EB_WAIT_FOREVER;
 
     while(1){
-        if(eb_queue_get(&bus->queue, &msg, EB_QUEUE_PERIOD) == 0){
-            evt = eb_get_event(bus, msg.evt_id);
-            msg.evt = evt;
-            if(evt != NULL){
-                if(eb_has_indirect_sub(bus, evt)){
-                    eb_worker_post(bus, msg.evt, 0, msg.data, msg.len);
-                }
+#if EB_MAX_TIMERS > 0
+        // the first dispatcher runs the timer wheel between two batches and
+        // sleeps until the next timer
+        if(shard == &bus->shards[0]){
+            timeout = eb_timer_run(&bus->timers, eb_timer_fire, bus);
+        }
+#endif
+
+        // block for the first message then drain whatever is already queued
+        nb = 0;
+        if(eb_inbox_get(&shard->inbox, &msgs[0], timeout) == 0){
+            nb++;
+            while(nb < EB_DISPATCH_BATCH && eb_inbox_get(&shard->inbox, &msgs[nb], 0) == 0){
+                nb++;
+            }
+        }
+
+        // queueing delay, publish to dispatch, the batch shares one timestamp
+        now = (uint32_t)eb_get_time_ns();
+        for(i = 0 ; i < nb ; i++){
+            eb_stats_add_delay(EB_STATS_LAT_QUEUE, now - msgs[i].pub_ns);
+            eb_trace(EB_TRACE_DEQUEUE, msgs[i].evt_id, msgs[i].pub_ns, msgs[i].len, shard - bus->shards, NULL);
+        }
+
+        eb_epoch_enter(shard);
+        patterns = atomic_load_explicit(&bus->patterns, memory_order_acquire);
 
-                eb_publish_direct(bus, msg.evt, msg.data, msg.len); 
+        // dispatch grouped by event, in order of first appearance. Messages
+        // of a given event keep their publish order
+        memset(done, 0, sizeof(done));
+        dispatched = 0;
+        for(i = 0 ; i < nb ; i++){
+            if(done[i]){
+                continue;
             }
 
-            eb_publish_all(bus, msg.evt, msg.evt_id, msg.data, msg.len);
+            // a single load, subscription changes apply from the next batch
+            evt = eb_get_event(bus, msgs[i].evt_id);
+            subs = evt != NULL ? atomic_load_explicit(&evt->subs, memory_order_acquire) : NULL;
+            psubs = eb_pat_idx_find(patterns, msgs[i].evt_id);
+            for(j = i ; j < nb ; j++){
+                if(!done[j] && msgs[j].evt_id == msgs[i].evt_id){
+                    done[j] = true;
+                    if((msgs[j].flags & EB_MSG_CONFLATED) && !eb_conflate_take(evt, &msgs[j])){
+                        continue;
+                    }
+                    eb_dispatch(bus, subs, psubs, &msgs[j]);
+                    dispatched++;
+                    if(evt != NULL){
+                        atomic_fetch_add_explicit(&evt->dispatched, 1, memory_order_relaxed);
+                    }
+                }
+            }
         }
-        eb_supv_run();
+        eb_stats_count(bus, EB_STATS_CNT_DISPATCHED, dispatched);
+
+        // no table loaded above is used past this point, retiring a table
+        // wakes an idle dispatcher up
+        eb_epoch_exit(shard);
+        eb_pat_idx_reclaim(bus);
+        eb_sub_tbl_reclaim(bus);
     }
     
 }
 
 static eb_evt_t *eb_get_event(eb_t *bus, uint32_t event_id)
 {
+#ifdef EB_EVT_LOOKUP_SIZE
+    int32_t index;
+
+    index = eb_lookup_find(&bus->lookup, event_id);
+    if(index >= 0){
+        return &bus->events[index];
+    }
+#else
     uint32_t i;
 
     for(i = 0 ; i < bus->nb_evt ; i++){
@@ -88,6 +245,7 @@ static eb_evt_t *eb_get_event(eb_t *bus, uint32_t event_id)
             return &bus->events[i];
         }
     }
+#endif
 
     return NULL;
 }
@@ -102,30 +260,69 @@ static eb_evt_t *eb_get_add_event(eb_t *bus, uint32_t event_id)
     if(evt == NULL && bus->nb_evt < MAX_NB_EVENTS){
         evt = &bus->events[bus->nb_evt];
         memset(evt, 0, sizeof(eb_evt_t));
+        evt->id = event_id;
+#ifdef EB_EVT_LOOKUP_SIZE
+        if(eb_lookup_insert(&bus->lookup, event_id, bus->nb_evt)){
+            return NULL;
+        }
+#endif
         bus->nb_evt++;
     }
     
     return evt;
 }
 
-static bool eb_sub_exists(eb_t *bus, eb_evt_t *evt, eb_sub_cb_t *cb)
+#if EB_USE_STATIC_SUBS
+// events of the static tables get their subscribers without any copy
+static int32_t eb_static_load(eb_t *bus)
+{
+    const eb_static_evt_t *entry;
+    eb_evt_t *evt;
+
+    if(__start_eb_static_evts == NULL){
+        return EVT_BUS_ERR_OK;
+    }
+
+    for(entry = __start_eb_static_evts ; entry < __stop_eb_static_evts ; entry++){
+        evt = eb_get_add_event(bus, entry->evt_id);
+        if(evt == NULL){
+            eb_log_err("no room for static event id 0x%lx\n", entry->evt_id);
+            return EVT_BUS_MEM_ERR;
+        }
+
+        if(atomic_load_explicit(&evt->subs, memory_order_relaxed) != NULL){
+            eb_log_err("static event id 0x%lx declared twice\n", entry->evt_id);
+            continue;
+        }
+
+        atomic_store_explicit(&evt->subs, (eb_sub_tbl_t *)entry->subs, memory_order_relaxed);
+    }
+
+    return EVT_BUS_ERR_OK;
+}
+#endif
+
+static int32_t eb_sub_find(eb_sub_tbl_t *subs, eb_sub_cb_t *cb)
 {
     uint32_t i = 0;
 
-    for(i = 0 ; i < evt->nb_sub ; i++){
-        if(evt->subs[i].cb == cb){
-            return true;
+    for(i = 0 ; subs != NULL && i < subs->nb_sub ; i++){
+        if(subs->subs[i].cb == cb){
+            return (int32_t)i;
         }
     }
 
-    return false;
+    return -1;
 }
 
 static int32_t eb_subscribe(eb_t *bus, const char *name, bool direct, uint32_t event_id, void *arg, eb_sub_cb_t *cb)
 {
-    uint32_t i = 0;
+    uint32_t nb_sub;
+    int32_t rc = EVT_BUS_ERR_OK;
     eb_evt_t *evt;
     eb_sub_t *sub;
+    eb_sub_tbl_t *subs;
+    eb_sub_tbl_t *new_subs;
 
     if(eb_lock(bus)){
         return EVT_BUS_LOCK_ERR;
@@ -134,25 +331,41 @@ static int32_t eb_subscribe(eb_t *bus, const char *name, bool direct, uint32_t e
     evt = eb_get_add_event(bus, event_id);
 
     if(evt == NULL){
+        eb_unlock(bus);
         return EVT_BUS_MEM_ERR;
     }
 
-    evt->id = event_id;
+    // tables only change under the bus lock
+    subs = atomic_load_explicit(&evt->subs, memory_order_relaxed);
+    if(eb_sub_find(subs, cb) >= 0){
+        goto exit;
+    }
+
+    nb_sub = subs != NULL ? subs->nb_sub : 0;
+    if(nb_sub >= MAX_NB_SUBSCRIBERS){
+        rc = EVT_BUS_MEM_ERR;
+        goto exit;
+    }
 
-    if(eb_sub_exists(bus, evt, cb)){
+    new_subs = eb_sub_tbl_new(subs, nb_sub + 1);
+    if(new_subs == NULL){
+        rc = EVT_BUS_ALLOC_ERR;
         goto exit;
     }
 
-    sub = &evt->subs[evt->nb_sub++];
-    memset(sub, 0, sizeof(eb_sub_t));
+    sub = &new_subs->subs[nb_sub];
     sub->cb = cb;
     sub->arg = arg;
     sub->direct = direct;
     strncpy(sub->name, name, MIN(strlen(name), EB_SUB_NAME_MAX_LEN-1));
+    sub->stats_id = eb_stats_intern(sub->name);
+
+    atomic_store_explicit(&evt->subs, new_subs, memory_order_release);
+    eb_sub_tbl_retire(bus, subs);
 
 exit:
     eb_unlock(bus);
-    return EVT_BUS_ERR_OK;
+    return rc;
 }
 
 static int32_t eb_subscribe_all(eb_t *bus, bool direct, void *arg, eb_sub_cb_t *cb)
@@ -162,6 +375,7 @@ static int32_t eb_subscribe_all(eb_t *bus, bool direct, void *arg, eb_sub_cb_t *
     }
 
     strcpy(bus->all_sub.name, "all_sub");
+    bus->all_sub.stats_id = eb_stats_intern(bus->all_sub.name);
     bus->all_sub.arg = arg;
     bus->all_sub.cb = cb;
     bus->all_sub.direct = direct;
@@ -170,86 +384,49 @@ static int32_t eb_subscribe_all(eb_t *bus, bool direct, void *arg, eb_sub_cb_t *
     return EVT_BUS_ERR_OK;
 }
 
-static int32_t eb_publish_direct(eb_t *bus, eb_evt_t *evt, void *data, uint32_t len)
+static int32_t eb_publish_direct(eb_t *bus, eb_sub_tbl_t *subs, eb_msg_t *msg)
 {
     uint32_t i;
     eb_sub_t *sub;
 
-    if(evt == NULL){
+    if(subs == NULL){
         return EVT_BUS_PUB_ERR;
     }
 
-    for(i = 0 ; i < evt->nb_sub ; i++){
-        sub = &evt->subs[i];
+    for(i = 0 ; i < subs->nb_sub ; i++){
+        sub = &subs->subs[i];
 
         if(sub->direct && sub->cb){
-            eb_worker_exec(bus, sub, evt->id, data, len);
+            eb_worker_exec(bus, sub, msg);
         }
     }
 
     return EVT_BUS_ERR_OK;
 }
 
-static int32_t eb_publish(eb_t *bus, eb_evt_t *evt, void *data, uint32_t len, uint32_t prio)
+static int32_t eb_publish_all(eb_t *bus, eb_msg_t *msg)
 {
-    eb_msg_t msg;
-
-    msg.evt = evt;
-    msg.len = len;
-
-    if(len > 0){
-        msg.data = eb_malloc(len); //TODO: replace by a mempool alloc
-        if(msg.data == NULL){
-            eb_log_err("data alloc failed for event id 0x%lx\n", evt->id);
-            return EVT_BUS_ALLOC_ERR;
-        }
-        memcpy(msg.data, data, len);
-    }
-
-    if(eb_queue_push(&bus->queue, (void *)&msg, prio, EB_PUBLISH_TIMEOUT)){
-        if(msg.data){
-            eb_free(msg.data);
-        }
-        eb_log_err("failed to publish event id 0x%lx\n", evt->id);
-        return EVT_BUS_PUB_ERR;
+    // indirect all_sub is called by the worker handling the event
+    if(bus->all_sub.cb != NULL && bus->all_sub.direct){
+        eb_worker_exec(bus, &bus->all_sub, msg);
     }
 
     return EVT_BUS_ERR_OK;
 }
 
-static int32_t eb_publish_all(eb_t *bus, eb_evt_t *evt, uint32_t event_id, void *data, uint32_t len)
-{
-    static eb_evt_t fake_evt;
-
-    if(bus->all_sub.direct){
-        eb_worker_exec(bus, &bus->all_sub, event_id, data, len);
-    }else{
-        // if evt == NULL this means we don't have any subscriber to this
-        // event. We still need to call the all_sub cb, to do so we need to 
-        // create a fake event with the current event id
-        if(evt == NULL){
-            memset(&fake_evt, 0, sizeof(fake_evt));
-            fake_evt.id = event_id;
-            fake_evt.nb_sub = 0;
-            evt = &fake_evt;
-        }
-
-        return eb_publish(bus, evt, data, len, EVENT_BUS_LOW_PRIO);
-    }
-    return 0;
-}
-
-static bool eb_has_indirect_sub(eb_t *bus, eb_evt_t *evt)
+static bool eb_has_indirect_sub(eb_t *bus, eb_sub_tbl_t *subs)
 {
     uint32_t i;
     eb_sub_t *sub;
 
-    if(evt == NULL){
+    (void)bus;
+
+    if(subs == NULL){
         return false;
     }
 
-    for(i = 0 ; i < evt->nb_sub ; i++){
-        sub = &evt->subs[i];
+    for(i = 0 ; i < subs->nb_sub ; i++){
+        sub = &subs->subs[i];
 
         if(!sub->direct){
             return true;
@@ -261,10 +438,11 @@ static bool eb_has_indirect_sub(eb_t *bus, eb_evt_t *evt)
 
 int32_t eb_unsub(eb_t *bus, uint32_t event_id, eb_sub_cb_t *cb)
 {
-    uint32_t i;
-    bool found = false;
+    int32_t index;
+    int32_t rc = EVT_BUS_ERR_OK;
     eb_evt_t *evt;
-    eb_sub_t *sub;
+    eb_sub_tbl_t *subs;
+    eb_sub_tbl_t *new_subs = NULL;
 
     if(eb_lock(bus)){
         return EVT_BUS_LOCK_ERR;
@@ -276,24 +454,123 @@ int32_t eb_unsub(eb_t *bus, uint32_t event_id, eb_sub_cb_t *cb)
         goto exit;
     }
 
-    for(i = 0 ; i < evt->nb_sub ; i++){
-        sub = &evt->subs[i];
-        if(sub->cb == cb){
-            found = true;
-            evt->nb_sub--;
+    subs = atomic_load_explicit(&evt->subs, memory_order_relaxed);
+    index = eb_sub_find(subs, cb);
+    if(index < 0){
+        goto exit;
+    }
+
+    // copy the subscribers before and after the removed one
+    if(subs->nb_sub > 1){
+        new_subs = eb_sub_tbl_new(subs, subs->nb_sub - 1);
+        if(new_subs == NULL){
+            rc = EVT_BUS_ALLOC_ERR;
+            goto exit;
         }
+        memcpy(&new_subs->subs[index], &subs->subs[index + 1], (subs->nb_sub - index - 1) * sizeof(eb_sub_t));
+    }
+
+    atomic_store_explicit(&evt->subs, new_subs, memory_order_release);
+    eb_sub_tbl_retire(bus, subs);
+
+exit:
+    eb_unlock(bus);
+    return rc;
+}
 
-        if(found){
-            memcpy(sub, &evt->subs[i+1], sizeof(eb_sub_t));
-            if(i == evt->nb_sub){
-                memset(&evt->subs[i+1], 0, sizeof(eb_sub_t));
+// supervision deadline of an indirect subscriber, 0 restores
+// EB_MAX_SUB_LATENCY_MS
+int32_t eb_sub_deadline(eb_t *bus, uint32_t event_id, eb_sub_cb_t *cb, uint32_t deadline_ms)
+{
+    int32_t index;
+    int32_t rc = EVT_BUS_NOT_FOUND_ERR;
+    eb_evt_t *evt;
+    eb_sub_tbl_t *subs;
+    eb_sub_tbl_t *new_subs;
+
+    if(eb_lock(bus)){
+        return EVT_BUS_LOCK_ERR;
+    }
+
+    evt = eb_get_event(bus, event_id);
+    subs = evt != NULL ? atomic_load_explicit(&evt->subs, memory_order_relaxed) : NULL;
+    index = eb_sub_find(subs, cb);
+    if(index < 0){
+        goto exit;
+    }
+
+    new_subs = eb_sub_tbl_new(subs, subs->nb_sub);
+    if(new_subs == NULL){
+        rc = EVT_BUS_ALLOC_ERR;
+        goto exit;
+    }
+
+    new_subs->subs[index].deadline_ms = deadline_ms;
+    atomic_store_explicit(&evt->subs, new_subs, memory_order_release);
+    eb_sub_tbl_retire(bus, subs);
+    rc = EVT_BUS_ERR_OK;
+
+exit:
+    eb_unlock(bus);
+    return rc;
+}
+
+static int32_t eb_subscribe_pattern(eb_t *bus, const char *name, bool direct, eb_pat_t *pats, uint32_t nb, void *arg, eb_sub_cb_t *cb)
+{
+    uint32_t i;
+    uint32_t j;
+    uint32_t nb_new = 0;
+    int32_t rc = EVT_BUS_ERR_OK;
+    eb_pat_idx_t *idx;
+    eb_pat_idx_t *new_idx;
+
+    if(eb_lock(bus)){
+        return EVT_BUS_LOCK_ERR;
+    }
+
+    // skip the ranges this callback already has
+    idx = atomic_load_explicit(&bus->patterns, memory_order_relaxed);
+    for(i = 0 ; i < nb ; i++){
+        for(j = 0 ; idx != NULL && j < idx->nb_pat ; j++){
+            if(idx->pats[j].sub.cb == cb && idx->pats[j].lo == pats[i].lo && idx->pats[j].hi == pats[i].hi){
+                break;
+            }
+        }
+
+        if(idx == NULL || j == idx->nb_pat){
+            if(nb_new != i){
+                memcpy(&pats[nb_new], &pats[i], sizeof(eb_pat_t));
             }
+            pats[nb_new].sub.cb = cb;
+            pats[nb_new].sub.arg = arg;
+            pats[nb_new].sub.direct = direct;
+            strncpy(pats[nb_new].sub.name, name, EB_SUB_NAME_MAX_LEN - 1);
+            pats[nb_new].sub.stats_id = eb_stats_intern(pats[nb_new].sub.name);
+            nb_new++;
         }
     }
 
+    if(nb_new == 0){
+        goto exit;
+    }
+
+    if((idx != NULL ? idx->nb_pat : 0) + nb_new > EB_MAX_PATTERNS){
+        rc = EVT_BUS_MEM_ERR;
+        goto exit;
+    }
+
+    new_idx = eb_pat_idx_new(idx, pats, nb_new, NULL);
+    if(new_idx == NULL){
+        rc = EVT_BUS_ALLOC_ERR;
+        goto exit;
+    }
+
+    atomic_store_explicit(&bus->patterns, new_idx, memory_order_release);
+    eb_pat_idx_retire(bus, idx);
+
 exit:
     eb_unlock(bus);
-    return EVT_BUS_ERR_OK;
+    return rc;
 }
 
 int32_t eb_sub_direct(eb_t *bus, const char *name, uint32_t event_id, void *arg, eb_sub_cb_t *cb)
@@ -316,64 +593,590 @@ int32_t eb_sub_all_indirect(eb_t *bus, void *arg, eb_sub_cb_t *cb)
     return eb_subscribe_all(bus, false, arg, cb);
 }
 
-int32_t eb_pub(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio)
+// ids with (id & mask) == (value & mask)
+int32_t eb_sub_mask(eb_t *bus, const char *name, uint32_t value, uint32_t mask, bool direct, void *arg, eb_sub_cb_t *cb)
 {
-    eb_msg_t msg;
-    int rc = EVT_BUS_ERR_OK;
+    eb_pat_t pats[EB_PAT_MAX_SPLIT];
+    int32_t nb;
+
+    nb = eb_pat_split(value, mask, pats, EB_PAT_MAX_SPLIT);
+    if(nb < 0){
+        return EVT_BUS_MEM_ERR;
+    }
+
+    return eb_subscribe_pattern(bus, name, direct, pats, (uint32_t)nb, arg, cb);
+}
+
+// ids from first to last included
+int32_t eb_sub_range(eb_t *bus, const char *name, uint32_t first, uint32_t last, bool direct, void *arg, eb_sub_cb_t *cb)
+{
+    eb_pat_t pat;
+
+    if(first > last){
+        return EVT_BUS_MEM_ERR;
+    }
+
+    memset(&pat, 0, sizeof(eb_pat_t));
+    pat.lo = first;
+    pat.hi = last;
+
+    return eb_subscribe_pattern(bus, name, direct, &pat, 1, arg, cb);
+}
+
+// remove every mask and range subscription of cb
+int32_t eb_unsub_pattern(eb_t *bus, eb_sub_cb_t *cb)
+{
+    int32_t rc = EVT_BUS_ERR_OK;
+    eb_pat_idx_t *idx;
+    eb_pat_idx_t *new_idx;
 
     if(eb_lock(bus)){
         return EVT_BUS_LOCK_ERR;
     }
-    
-    msg.evt_id = event_id;
-    msg.evt = NULL;
-    msg.len = len;
-
-    if(msg.len > 0){
-        msg.data = eb_malloc(len); //TODO: replace by a mempool alloc
-        if(msg.data == NULL){
-            eb_log_err("data alloc failed for event id 0x%lx\n", event_id);
+
+    idx = atomic_load_explicit(&bus->patterns, memory_order_relaxed);
+    if(idx != NULL){
+        new_idx = eb_pat_idx_new(idx, NULL, 0, cb);
+        if(new_idx == NULL){
             rc = EVT_BUS_ALLOC_ERR;
-            goto exit;
+        }else{
+            if(new_idx->nb_pat == 0){
+                eb_free(new_idx);
+                new_idx = NULL;
+            }
+            atomic_store_explicit(&bus->patterns, new_idx, memory_order_release);
+            eb_pat_idx_retire(bus, idx);
         }
-        memcpy(msg.data, data, len);
     }
 
-    if(eb_queue_push(&bus->queue, (void *)&msg, prio, EB_PUBLISH_TIMEOUT)){
-        if(msg.data){
-            eb_free(msg.data);
+    eb_unlock(bus);
+    return rc;
+}
+
+static inline eb_shard_t *eb_get_shard(eb_t *bus, uint32_t event_id)
+{
+    // ids often differ in their upper bits only, mix them down
+    event_id *= 0x9E3779B1U;
+    return &bus->shards[(event_id ^ (event_id >> 16)) % bus->nb_shards];
+}
+
+static bool eb_is_conflated(eb_t *bus, uint32_t event_id, eb_evt_t **evt)
+{
+    *evt = eb_get_event(bus, event_id);
+
+    return *evt != NULL && atomic_load_explicit(&(*evt)->conflate, memory_order_relaxed);
+}
+
+static uint32_t eb_get_policy(eb_t *bus, eb_evt_t *evt)
+{
+    uint32_t policy = EB_POLICY_DEFAULT;
+
+    if(evt != NULL){
+        policy = atomic_load_explicit(&evt->policy, memory_order_relaxed);
+    }
+
+    return policy != EB_POLICY_DEFAULT ? policy : bus->policy;
+}
+
+static void eb_reject(eb_t *bus, eb_evt_t *evt)
+{
+    atomic_fetch_add_explicit(&bus->rejected, 1, memory_order_relaxed);
+    if(evt != NULL){
+        atomic_fetch_add_explicit(&evt->rejected, 1, memory_order_relaxed);
+    }
+}
+
+static void eb_published(eb_t *bus, eb_evt_t *evt, uint32_t n)
+{
+    eb_stats_count(bus, EB_STATS_CNT_PUBLISHED, n);
+    if(evt != NULL){
+        atomic_fetch_add_explicit(&evt->published, n, memory_order_relaxed);
+    }
+}
+
+static void eb_msg_init(eb_msg_t *msg, uint32_t event_id, void *data, uint32_t len, uint32_t pub_ns)
+{
+    msg->evt_id = event_id;
+    msg->subs = NULL;
+    msg->psubs = NULL;
+    msg->len = len;
+    msg->data = data;
+    msg->pub_ns = pub_ns;
+    msg->flags = 0;
+}
+
+// the inbox is safe for concurrent publishers, no need for the bus lock. A
+// publisher that can't wait fails instead of blocking
+static int32_t eb_pub_msg(eb_t *bus, eb_evt_t *evt, eb_msg_t *msg, uint32_t prio, bool wait)
+{
+    eb_shard_t *shard = eb_get_shard(bus, msg->evt_id);
+    uint32_t policy = eb_get_policy(bus, evt);
+
+    if(!wait && policy == EB_POLICY_BLOCK){
+        policy = EB_POLICY_FAIL_FAST;
+    }
+
+    eb_trace(EB_TRACE_PUB, msg->evt_id, msg->pub_ns, msg->len, prio, NULL);
+    if(eb_inbox_push(&shard->inbox, msg, prio, policy, bus->pub_timeout)){
+        eb_trace(EB_TRACE_REJECT, msg->evt_id, msg->pub_ns, msg->len, shard - bus->shards, NULL);
+        if(msg->flags & EB_MSG_CONFLATED){
+            // nothing will take the pending payload, publishers merged into
+            // it meanwhile are dropped with it
+            eb_buf_release(atomic_exchange_explicit(&evt->latest, NULL, memory_order_acq_rel));
         }
-        eb_log_err("failed to publish event id 0x%lx\n", event_id);
-        rc = EVT_BUS_PUB_ERR;
-        goto exit;
+        eb_msg_release(msg);
+        eb_reject(bus, evt);
+        if(policy == EB_POLICY_BLOCK){
+            eb_stats_count(bus, EB_STATS_CNT_PUB_TIMEOUT, 1);
+        }
+        eb_log_err("failed to publish event id 0x%lx\n", msg->evt_id);
+        return EVT_BUS_PUB_ERR;
+    }
+    eb_trace(EB_TRACE_ENQUEUE, msg->evt_id, msg->pub_ns, msg->len, shard - bus->shards, NULL);
+    eb_published(bus, evt, 1);
+
+    return EVT_BUS_ERR_OK;
+}
+
+static int32_t eb_pub_buf_wait(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio, uint32_t pub_ns, bool wait)
+{
+    eb_msg_t msg;
+    eb_evt_t *evt;
+    int32_t rc;
+
+    eb_msg_init(&msg, event_id, data, len, pub_ns);
+
+    // a conflated event has at most one message queued, the payload is kept
+    // in the event. An empty buffer tells a pending publish without payload
+    if(eb_is_conflated(bus, event_id, &evt)){
+        if(data == NULL){
+            rc = eb_buf_alloc(bus, 0, &data);
+            if(rc){
+                return rc;
+            }
+        }
+
+        eb_buf_set_len(data, len);
+        if(eb_conflate_merge(evt, data)){
+            eb_published(bus, evt, 1);
+            return EVT_BUS_ERR_OK;
+        }
+
+        msg.data = NULL;
+        msg.len = 0;
+        msg.flags = EB_MSG_CONFLATED;
+    }
+
+    return eb_pub_msg(bus, evt, &msg, prio, wait);
+}
+
+int32_t eb_pub_buf(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio)
+{
+    return eb_pub_buf_wait(bus, event_id, data, len, prio, (uint32_t)eb_get_time_ns(), true);
+}
+
+int32_t eb_pub_at(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio, uint32_t pub_ns)
+{
+    void *buf = NULL;
+    eb_msg_t msg;
+    eb_evt_t *evt;
+    int32_t rc;
+
+    // small payloads travel in the message, a conflated event keeps its
+    // payload in the event so it needs a buffer
+    if(len > 0 && !eb_is_conflated(bus, event_id, &evt)){
+        eb_msg_init(&msg, event_id, NULL, len, pub_ns);
+        if(eb_msg_set_inline(&msg, data, len)){
+            return eb_pub_msg(bus, evt, &msg, prio, true);
+        }
+    }
+
+    if(len > 0){
+        rc = eb_buf_alloc(bus, len, &buf);
+        if(rc){
+            eb_log_err("data alloc failed for event id 0x%lx (%ld)\n", event_id, rc);
+            return rc;
+        }
+        memcpy(buf, data, len);
+    }
+
+    return eb_pub_buf_wait(bus, event_id, buf, len, prio, pub_ns, true);
+}
+
+int32_t eb_pub(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio)
+{
+    return eb_pub_at(bus, event_id, data, len, prio, (uint32_t)eb_get_time_ns());
+}
+
+#if EB_MAX_TIMERS > 0
+// runs in the first dispatcher with the wheel locked, a full inbox fails the
+// firing instead of blocking the dispatcher
+static void eb_timer_fire(void *ctx, eb_timer_t *timer)
+{
+    eb_t *bus = (eb_t *)ctx;
+
+    eb_buf_ref(timer->data);
+    eb_pub_buf_wait(bus, timer->evt_id, timer->data, timer->len, timer->prio, (uint32_t)eb_get_time_ns(), false);
+}
+
+static int32_t eb_pub_timer(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio,
+    uint32_t delay_ms, uint32_t period_ms, eb_timer_id_t *id)
+{
+    void *buf = NULL;
+    bool kick;
+    int32_t rc;
+
+    // copied once, every firing shares the buffer
+    if(len > 0){
+        rc = eb_buf_alloc(bus, len, &buf);
+        if(rc){
+            eb_log_err("data alloc failed for event id 0x%lx (%ld)\n", event_id, rc);
+            return rc;
+        }
+        memcpy(buf, data, len);
+    }
+
+    rc = eb_timer_add(&bus->timers, event_id, buf, len, prio, delay_ms, period_ms, id, &kick);
+    if(rc == EVT_BUS_ERR_OK && kick){
+        eb_inbox_kick(&bus->shards[0].inbox);
+    }
+
+    return rc;
+}
+
+// id may be NULL when the event won't be cancelled
+int32_t eb_pub_delayed(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio, uint32_t delay_ms, eb_timer_id_t *id)
+{
+    return eb_pub_timer(bus, event_id, data, len, prio, delay_ms, 0, id);
+}
+
+// first published one period from now
+int32_t eb_pub_periodic(eb_t *bus, uint32_t event_id, void *data, uint32_t len, uint32_t prio, uint32_t period_ms, eb_timer_id_t *id)
+{
+    if(period_ms == 0){
+        return EVT_BUS_TIMER_ERR;
+    }
+
+    return eb_pub_timer(bus, event_id, data, len, prio, period_ms, period_ms, id);
+}
+
+int32_t eb_timer_cancel(eb_t *bus, eb_timer_id_t id)
+{
+    return eb_timer_del(&bus->timers, id);
+}
+#endif
+
+int32_t eb_pub_batch(eb_t *bus, const eb_pub_msg_t *msgs, uint32_t nb, uint32_t prio)
+{
+    eb_msg_t batch[EB_DISPATCH_BATCH];
+    eb_shard_t *shard;
+    eb_evt_t *evt;
+    uint32_t i;
+    uint32_t j;
+    uint32_t end;
+    uint32_t n;
+    uint32_t count;
+    uint32_t pushed;
+    uint32_t policy;
+    uint32_t now;
+    int32_t rc = EVT_BUS_ERR_OK;
+    int32_t err;
+
+    while(nb > 0 && rc == EVT_BUS_ERR_OK){
+        count = MIN(nb, EB_DISPATCH_BATCH);
+        now = (uint32_t)eb_get_time_ns();
+
+        for(i = 0, n = 0 ; i < count ; i++){
+            // conflated events go through the single message path
+            if(eb_is_conflated(bus, msgs[i].evt_id, &evt)){
+                rc = eb_pub(bus, msgs[i].evt_id, msgs[i].data, msgs[i].len, prio);
+                if(rc){
+                    count = i + 1;
+                    break;
+                }
+                continue;
+            }
+
+            eb_msg_init(&batch[n], msgs[i].evt_id, NULL, msgs[i].len, now);
+            if(msgs[i].len > 0 && !eb_msg_set_inline(&batch[n], msgs[i].data, msgs[i].len)){
+                rc = eb_buf_alloc(bus, msgs[i].len, &batch[n].data);
+                if(rc){
+                    eb_log_err("data alloc failed for event id 0x%lx (%ld)\n", msgs[i].evt_id, rc);
+                    count = i;
+                    break;
+                }
+                memcpy(batch[n].data, msgs[i].data, msgs[i].len);
+            }
+            eb_trace(EB_TRACE_PUB, batch[n].evt_id, now, batch[n].len, prio, NULL);
+            n++;
+        }
+
+        // runs of messages going to the same dispatcher are queued at once,
+        // what did not fit follows the policy of its event. After the first
+        // failure the rest of the batch is rejected
+        for(i = 0, err = EVT_BUS_ERR_OK ; i < n ; i = end){
+            shard = eb_get_shard(bus, batch[i].evt_id);
+            for(end = i + 1 ; end < n && eb_get_shard(bus, batch[end].evt_id) == shard ; end++);
+
+            pushed = err == EVT_BUS_ERR_OK ? eb_inbox_push_batch(&shard->inbox, &batch[i], end - i, prio) : 0;
+            for(j = i ; j < i + pushed ; j++){
+                eb_trace(EB_TRACE_ENQUEUE, batch[j].evt_id, now, batch[j].len, shard - bus->shards, NULL);
+                eb_published(bus, eb_get_event(bus, batch[j].evt_id), 1);
+            }
+
+            for(j = i + pushed ; j < end ; j++){
+                evt = eb_get_event(bus, batch[j].evt_id);
+                if(err == EVT_BUS_ERR_OK){
+                    policy = eb_get_policy(bus, evt);
+                    err = eb_inbox_push(&shard->inbox, &batch[j], prio, policy, bus->pub_timeout);
+                    if(err == EVT_BUS_ERR_OK){
+                        eb_trace(EB_TRACE_ENQUEUE, batch[j].evt_id, now, batch[j].len, shard - bus->shards, NULL);
+                        eb_published(bus, evt, 1);
+                        continue;
+                    }
+                    if(policy == EB_POLICY_BLOCK){
+                        eb_stats_count(bus, EB_STATS_CNT_PUB_TIMEOUT, 1);
+                    }
+                    eb_log_err("failed to publish %ld events\n", n - j);
+                    rc = EVT_BUS_PUB_ERR;
+                }
+                eb_trace(EB_TRACE_REJECT, batch[j].evt_id, now, batch[j].len, shard - bus->shards, NULL);
+                eb_msg_release(&batch[j]);
+                eb_reject(bus, evt);
+            }
+        }
+
+        msgs += count;
+        nb -= count;
     }
 
-exit:
-    eb_unlock(bus);
     return rc;
 }
             
+uint32_t eb_get_depth(eb_t *bus, uint32_t prio)
+{
+    uint32_t depth = 0;
+    uint32_t i;
+
+    for(i = 0 ; i < bus->nb_shards ; i++){
+        depth += eb_inbox_depth(&bus->shards[i].inbox, prio);
+    }
+
+    return depth;
+}
+
+// keep only the latest pending payload of event_id
+int32_t eb_conflate(eb_t *bus, uint32_t event_id, bool enable)
+{
+    eb_evt_t *evt;
+
+    if(eb_lock(bus)){
+        return EVT_BUS_LOCK_ERR;
+    }
+
+    evt = eb_get_add_event(bus, event_id);
+    if(evt == NULL){
+        eb_unlock(bus);
+        return EVT_BUS_MEM_ERR;
+    }
+
+    atomic_store_explicit(&evt->conflate, enable, memory_order_relaxed);
+
+    eb_unlock(bus);
+    return EVT_BUS_ERR_OK;
+}
+
+uint32_t eb_get_merged(eb_t *bus, uint32_t event_id)
+{
+    eb_evt_t *evt = eb_get_event(bus, event_id);
+
+    return evt != NULL ? atomic_load_explicit(&evt->merged, memory_order_relaxed) : 0;
+}
+
+int32_t eb_set_policy(eb_t *bus, uint32_t event_id, eb_policy_t policy)
+{
+    eb_evt_t *evt;
+
+    if(eb_lock(bus)){
+        return EVT_BUS_LOCK_ERR;
+    }
+
+    evt = eb_get_add_event(bus, event_id);
+    if(evt == NULL){
+        eb_unlock(bus);
+        return EVT_BUS_MEM_ERR;
+    }
+
+    atomic_store_explicit(&evt->policy, policy, memory_order_relaxed);
+
+    eb_unlock(bus);
+    return EVT_BUS_ERR_OK;
+}
+
+// the high watermark is the one of the busiest dispatcher
+void eb_get_overflow(eb_t *bus, eb_overflow_t *ovf)
+{
+    uint32_t high;
+    uint32_t i;
+
+    ovf->dropped = atomic_load_explicit(&bus->dropped, memory_order_relaxed);
+    ovf->rejected = atomic_load_explicit(&bus->rejected, memory_order_relaxed);
+    ovf->high_watermark = 0;
+    for(i = 0 ; i < bus->nb_shards ; i++){
+        high = eb_inbox_high_watermark(&bus->shards[i].inbox);
+        ovf->high_watermark = high > ovf->high_watermark ? high : ovf->high_watermark;
+    }
+}
+
+int32_t eb_get_evt_overflow(eb_t *bus, uint32_t event_id, eb_evt_overflow_t *ovf)
+{
+    eb_evt_t *evt = eb_get_event(bus, event_id);
+
+    if(evt == NULL){
+        return EVT_BUS_NOT_FOUND_ERR;
+    }
+
+    ovf->dropped = atomic_load_explicit(&evt->dropped, memory_order_relaxed);
+    ovf->rejected = atomic_load_explicit(&evt->rejected, memory_order_relaxed);
+
+    return EVT_BUS_ERR_OK;
+}
+
+// counters are read one by one without stopping the bus, they may be a few
+// events apart from each other
+uint32_t eb_stats_snapshot(eb_t *bus, eb_snapshot_t *snap, eb_snapshot_evt_t *evts, uint32_t nb_evts)
+{
+    eb_counters_t *counters;
+    eb_evt_t *evt;
+    uint32_t nb_evt;
+    uint32_t high;
+    uint32_t i;
+    uint32_t j;
+
+    memset(snap, 0, sizeof(eb_snapshot_t));
+    for(i = 0 ; i < EB_STATS_NB_SHARDS ; i++){
+        counters = &bus->counters[i];
+        for(j = 0 ; j < EB_STATS_NB_CNT ; j++){
+            snap->cnt[j] += atomic_load_explicit(&counters->cnt[j], memory_order_relaxed);
+        }
+        snap->busy_ns += atomic_load_explicit(&counters->busy_ns, memory_order_relaxed);
+    }
+
+    snap->dropped = atomic_load_explicit(&bus->dropped, memory_order_relaxed);
+    snap->rejected = atomic_load_explicit(&bus->rejected, memory_order_relaxed);
+    for(i = 0 ; i < bus->nb_shards ; i++){
+        for(j = 0 ; j < EB_NB_PRIO_LEVELS ; j++){
+            snap->depth += eb_inbox_depth(&bus->shards[i].inbox, j);
+        }
+        high = eb_inbox_high_watermark(&bus->shards[i].inbox);
+        snap->high_watermark = high > snap->high_watermark ? high : snap->high_watermark;
+    }
+
+    // events are added under the bus lock and never removed
+    if(eb_lock(bus)){
+        return 0;
+    }
+    nb_evt = bus->nb_evt;
+    eb_unlock(bus);
+
+    snap->nb_evt = nb_evt;
+    nb_evts = evts != NULL ? MIN(nb_evts, nb_evt) : 0;
+    for(i = 0 ; i < nb_evts ; i++){
+        evt = &bus->events[i];
+        evts[i].event_id = evt->id;
+        evts[i].published = atomic_load_explicit(&evt->published, memory_order_relaxed);
+        evts[i].dispatched = atomic_load_explicit(&evt->dispatched, memory_order_relaxed);
+        evts[i].merged = atomic_load_explicit(&evt->merged, memory_order_relaxed);
+        evts[i].dropped = atomic_load_explicit(&evt->dropped, memory_order_relaxed);
+        evts[i].rejected = atomic_load_explicit(&evt->rejected, memory_order_relaxed);
+    }
+
+    return nb_evts;
+}
+
 int32_t eb_init(eb_t *bus, void *app_ctx)
 {
+    return eb_init_cfg(bus, app_ctx, NULL);
+}
+
+int32_t eb_init_cfg(eb_t *bus, void *app_ctx, const eb_cfg_t *cfg)
+{
+    uint32_t nb_workers = MAX_NB_WORKERS;
+    eb_shard_t *shard;
+    uint32_t i;
+
+    if(cfg != NULL && cfg->nb_workers > 0){
+        nb_workers = cfg->nb_workers;
+    }
+
+    bus->nb_shards = 1;
+    if(cfg != NULL && cfg->nb_dispatchers > 0){
+        bus->nb_shards = MIN(cfg->nb_dispatchers, EB_MAX_DISPATCHERS);
+    }
+
     bus->nb_evt = 0;
     bus->app_ctx = app_ctx;
+    bus->policy = (cfg != NULL && cfg->policy != EB_POLICY_DEFAULT) ? cfg->policy : EB_PUBLISH_POLICY;
+    bus->pub_timeout = (cfg != NULL && cfg->pub_timeout > 0) ? cfg->pub_timeout : EB_PUBLISH_TIMEOUT;
+    atomic_init(&bus->dropped, 0);
+    atomic_init(&bus->rejected, 0);
+    memset(bus->counters, 0, sizeof(bus->counters));
     
     if(eb_mutex_new(&bus->mutex)){
         return EVT_BUS_MUTEX_ERR;
     }
 
     memset(bus->events, 0, sizeof(eb_evt_t) *  MAX_NB_EVENTS);
+#ifdef EB_EVT_LOOKUP_SIZE
+    eb_lookup_init(&bus->lookup);
+#endif
     memset(&bus->all_sub, 0, sizeof(eb_sub_t));
+    atomic_init(&bus->retired, NULL);
+    atomic_init(&bus->patterns, NULL);
+    atomic_init(&bus->retired_pat, NULL);
+    atomic_init(&bus->epoch, 1);
+
+    if(eb_mpool_init()){
+        return EVT_BUS_POOL_ERR;
+    }
+
+#if EB_USE_STATIC_SUBS
+    if(eb_static_load(bus)){
+        return EVT_BUS_MEM_ERR;
+    }
+#endif
 
-    if(eb_queue_new(&bus->queue, sizeof(eb_msg_t), EB_QUEUE_LEN)){
-        return EVT_BUS_QUEUE_ERR;
+#if EB_MAX_TIMERS > 0
+    if(eb_timer_init(&bus->timers)){
+        return EVT_BUS_MUTEX_ERR;
+    }
+#endif
+
+    // every inbox exists before a dispatcher can publish to another one
+    for(i = 0 ; i < bus->nb_shards ; i++){
+        shard = &bus->shards[i];
+        shard->bus = bus;
+        atomic_init(&shard->epoch, 0);
+        snprintf(shard->name, sizeof(shard->name), "eb_th_%ld", (long)i);
+        if(eb_inbox_init(&shard->inbox, eb_drop, bus)){
+            return EVT_BUS_QUEUE_ERR;
+        }
     }
 
-    if(eb_thread_new("eb_th", eb_thread, (void *)bus, EB_STACK_SIZE, EB_PRIO) == NULL){
-        return EVT_BUS_THREAD_ERR;
+    for(i = 0 ; i < bus->nb_shards ; i++){
+        shard = &bus->shards[i];
+        shard->thread = eb_thread_new(shard->name, eb_thread, (void *)shard, EB_STACK_SIZE, EB_PRIO);
+        if(shard->thread == NULL){
+            return EVT_BUS_THREAD_ERR;
+        }
+
+        // pinning is best effort, the bus works the same without it
+        if(cfg != NULL && eb_thread_set_affinity(shard->thread, cfg->dispatcher_affinity[i])){
+            eb_log_warn("%s can't be pinned to 0x%lx\n", shard->name, (unsigned long)cfg->dispatcher_affinity[i]);
+        }
     }
 
-    if(eb_worker_init(bus)){
+    if(eb_worker_init(bus, nb_workers, cfg != NULL ? cfg->worker_affinity : NULL)){
         return EVT_WORKER_ERR;
     }
 
@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include "event_bus_buf.h"
+#include "event_bus_mpool.h"
+#include "event_bus_stats.h"
+
+// header stored in front of every payload, its size keeps the payload 8
+// bytes aligned inside the pool block
+typedef struct eb_buf_hdr_t
+{
+    atomic_uint refcnt;
+    uint32_t len;
+}eb_buf_hdr_t;
+
+#define EB_BUF_HDR(data)            ((eb_buf_hdr_t *)(data) - 1)
+
+_Static_assert(sizeof(eb_buf_hdr_t) == EB_MPOOL_HDR_LEN, "pool blocks don't fit the buffer header");
+
+int32_t eb_buf_alloc(eb_t *bus, uint32_t len, void **data)
+{
+    int32_t rc;
+    eb_buf_hdr_t *hdr;
+
+    *data = NULL;
+
+    rc = eb_mpool_alloc(len + sizeof(eb_buf_hdr_t), (void **)&hdr);
+    if(rc){
+        eb_stats_count(bus, EB_STATS_CNT_ALLOC_FAILED, 1);
+        return rc;
+    }
+
+    atomic_init(&hdr->refcnt, 1);
+    hdr->len = len;
+    *data = hdr + 1;
+
+    return EVT_BUS_ERR_OK;
+}
+
+void eb_buf_free(void *data)
+{
+    eb_buf_release(data);
+}
+
+void eb_buf_ref(void *data)
+{
+    if(data == NULL){
+        return;
+    }
+
+    atomic_fetch_add_explicit(&EB_BUF_HDR(data)->refcnt, 1, memory_order_relaxed);
+}
+
+void eb_buf_release(void *data)
+{
+    eb_buf_hdr_t *hdr;
+
+    if(data == NULL){
+        return;
+    }
+
+    hdr = EB_BUF_HDR(data);
+    if(atomic_fetch_sub_explicit(&hdr->refcnt, 1, memory_order_acq_rel) == 1){
+        eb_mpool_free(hdr);
+    }
+}
+
+// length of the published payload, at most the allocated one
+void eb_buf_set_len(void *data, uint32_t len)
+{
+    EB_BUF_HDR(data)->len = len;
+}
+
+uint32_t eb_buf_len(void *data)
+{
+    return data != NULL ? EB_BUF_HDR(data)->len : 0;
+}
+
+// copies a small payload in the message itself, false when it doesn't fit
+bool eb_msg_set_inline(eb_msg_t *msg, const void *data, uint32_t len)
+{
+#if EB_INLINE_PAYLOAD_LEN > 0
+    if(len > EB_INLINE_PAYLOAD_LEN){
+        return false;
+    }
+
+    memcpy(msg->inl, data, len);
+    msg->data = NULL;
+    msg->len = len;
+    msg->flags |= EB_MSG_INLINE;
+    eb_stats_add_alloc(EB_STATS_ALLOC_INLINE);
+
+    return true;
+#else
+    (void)msg;
+    (void)data;
+    (void)len;
+    return false;
+#endif
+}
+
+void *eb_msg_data(eb_msg_t *msg)
+{
+#if EB_INLINE_PAYLOAD_LEN > 0
+    if(msg->flags & EB_MSG_INLINE){
+        return msg->inl;
+    }
+#endif
+
+    return msg->data;
+}
+
+// an inline payload is copied with the message, only buffers are shared
+void eb_msg_ref(eb_msg_t *msg)
+{
+    if(!(msg->flags & EB_MSG_INLINE)){
+        eb_buf_ref(msg->data);
+    }
+}
+
+void eb_msg_release(eb_msg_t *msg)
+{
+    if(!(msg->flags & EB_MSG_INLINE)){
+        eb_buf_release(msg->data);
+    }
+}
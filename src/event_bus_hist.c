@@ -0,0 +1,165 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include <string.h>
+#include "event_bus_hist.h"
+
+#define EB_LAT_HIST_SUB_COUNT       (1U << EB_LAT_HIST_SUB_BITS)
+
+static uint32_t eb_lat_hist_index(uint32_t value)
+{
+    uint32_t shift;
+
+    if(value < (EB_LAT_HIST_SUB_COUNT << 1)){
+        return value;
+    }
+
+    // keep the EB_LAT_HIST_SUB_BITS bits following the most significant one
+    shift = (31 - __builtin_clz(value)) - EB_LAT_HIST_SUB_BITS;
+    return (shift << EB_LAT_HIST_SUB_BITS) + (value >> shift);
+}
+
+// highest value counted in a bucket
+static uint32_t eb_lat_hist_value(uint32_t index)
+{
+    uint32_t shift = 0;
+    uint64_t top;
+
+    if(index >= (EB_LAT_HIST_SUB_COUNT << 1)){
+        shift = (index >> EB_LAT_HIST_SUB_BITS) - 1;
+    }
+    top = index - (shift << EB_LAT_HIST_SUB_BITS);
+
+    return (uint32_t)(((top + 1) << shift) - 1);
+}
+
+static uint32_t eb_lat_hist_lowest(uint32_t index)
+{
+    uint32_t shift = 0;
+
+    if(index >= (EB_LAT_HIST_SUB_COUNT << 1)){
+        shift = (index >> EB_LAT_HIST_SUB_BITS) - 1;
+    }
+
+    return (index - (shift << EB_LAT_HIST_SUB_BITS)) << shift;
+}
+
+void eb_lat_hist_add(eb_lat_hist_t *hist, uint32_t value)
+{
+    uint32_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+
+    atomic_fetch_add_explicit(&hist->buckets[eb_lat_hist_index(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+
+    while(value > max && !atomic_compare_exchange_weak_explicit(&hist->max, &max, value,
+        memory_order_relaxed, memory_order_relaxed)){
+    }
+}
+
+uint32_t eb_lat_hist_percentile(const uint32_t *buckets, uint32_t count, uint32_t pct)
+{
+    uint32_t i;
+    uint64_t seen = 0;
+    uint64_t rank = ((uint64_t)count * pct + 9999) / 10000;
+
+    if(rank == 0){
+        rank = 1;
+    }
+
+    for(i = 0 ; i < EB_LAT_HIST_NB_BUCKETS ; i++){
+        seen += buckets[i];
+        if(seen >= rank){
+            return eb_lat_hist_value(i);
+        }
+    }
+
+    return 0;
+}
+
+// a reset swaps each counter for 0, samples added meanwhile are kept
+// either in this snapshot or in the next one
+void eb_lat_hist_get(eb_lat_hist_t *hist, eb_lat_stats_t *stats, bool reset)
+{
+    eb_lat_hist_merge(&hist, 1, stats, reset);
+}
+
+// stats of the union of nb histograms
+void eb_lat_hist_merge(eb_lat_hist_t *const *hists, uint32_t nb, eb_lat_stats_t *stats, bool reset)
+{
+    uint32_t i;
+    uint32_t j;
+    uint32_t max;
+    uint32_t count = 0;
+    uint64_t sum = 0;
+    uint32_t buckets[EB_LAT_HIST_NB_BUCKETS];
+
+    memset(stats, 0, sizeof(eb_lat_stats_t));
+    memset(buckets, 0, sizeof(buckets));
+
+    for(j = 0 ; j < nb ; j++){
+        for(i = 0 ; i < EB_LAT_HIST_NB_BUCKETS ; i++){
+            if(reset){
+                buckets[i] += atomic_exchange_explicit(&hists[j]->buckets[i], 0, memory_order_relaxed);
+            }else{
+                buckets[i] += atomic_load_explicit(&hists[j]->buckets[i], memory_order_relaxed);
+            }
+        }
+
+        if(reset){
+            sum += atomic_exchange_explicit(&hists[j]->sum, 0, memory_order_relaxed);
+            max = atomic_exchange_explicit(&hists[j]->max, 0, memory_order_relaxed);
+        }else{
+            sum += atomic_load_explicit(&hists[j]->sum, memory_order_relaxed);
+            max = atomic_load_explicit(&hists[j]->max, memory_order_relaxed);
+        }
+        stats->max = max > stats->max ? max : stats->max;
+    }
+
+    for(i = 0 ; i < EB_LAT_HIST_NB_BUCKETS ; i++){
+        if(buckets[i] > 0 && count == 0){
+            stats->min = eb_lat_hist_lowest(i);
+        }
+        count += buckets[i];
+    }
+
+    if(count == 0){
+        return;
+    }
+
+    stats->count = count;
+    stats->mean = (uint32_t)(sum / count);
+    // a bucket upper bound can be above the highest recorded value
+    stats->p50 = eb_lat_hist_percentile(buckets, count, EB_LAT_P50);
+    stats->p99 = eb_lat_hist_percentile(buckets, count, EB_LAT_P99);
+    stats->p999 = eb_lat_hist_percentile(buckets, count, EB_LAT_P999);
+    stats->p50 = MIN(stats->p50, stats->max);
+    stats->p99 = MIN(stats->p99, stats->max);
+    stats->p999 = MIN(stats->p999, stats->max);
+}
@@ -0,0 +1,352 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "event_bus_inbox.h"
+#include "event_bus_ring.h"
+
+#ifdef EB_PRIO_WEIGHTS
+static const uint32_t eb_prio_weights[EB_NB_PRIO_LEVELS] = EB_PRIO_WEIGHTS;
+#endif
+
+static inline uint32_t eb_inbox_level(uint32_t prio)
+{
+    return MIN(prio, EB_NB_PRIO_LEVELS - 1);
+}
+
+static void eb_inbox_wake(eb_inbox_t *inbox)
+{
+    // the dispatcher sets sleeping before checking the levels a last time,
+    // seq_cst ordering makes sure one of us sees the other
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&inbox->sleeping, memory_order_relaxed) &&
+        atomic_exchange(&inbox->sleeping, 0)){
+        eb_sem_give(&inbox->wake);
+    }
+}
+
+int32_t eb_inbox_init(eb_inbox_t *inbox, eb_inbox_drop_cb_t *drop, void *drop_ctx)
+{
+    uint32_t i;
+
+    for(i = 0 ; i < EB_NB_PRIO_LEVELS ; i++){
+#if EB_USE_MPSC_RING
+        eb_ring_init(&inbox->rings[i]);
+#else
+        if(eb_queue_new(&inbox->queues[i], sizeof(eb_msg_t), EB_QUEUE_LEN)){
+            return EVT_BUS_QUEUE_ERR;
+        }
+#endif
+        atomic_init(&inbox->depth[i], 0);
+#ifdef EB_PRIO_WEIGHTS
+        inbox->credit[i] = eb_prio_weights[i];
+#endif
+    }
+
+    atomic_init(&inbox->total, 0);
+    atomic_init(&inbox->high, 0);
+    inbox->drop = drop;
+    inbox->drop_ctx = drop_ctx;
+
+    atomic_init(&inbox->sleeping, 0);
+    atomic_init(&inbox->kicked, 0);
+    if(eb_sem_new(&inbox->wake)){
+        return EVT_BUS_QUEUE_ERR;
+    }
+
+    atomic_init(&inbox->waiters, 0);
+    if(eb_sem_new(&inbox->space)){
+        return EVT_BUS_QUEUE_ERR;
+    }
+
+    return EVT_BUS_ERR_OK;
+}
+
+// take up to nb of the slots shared by all levels. Every level can hold
+// EB_QUEUE_LEN messages so a reserved slot is always free in its level
+static uint32_t eb_inbox_reserve(eb_inbox_t *inbox, uint32_t nb)
+{
+    uint32_t total;
+    uint32_t high;
+    uint32_t n;
+
+    total = atomic_load_explicit(&inbox->total, memory_order_relaxed);
+    do{
+        if(total >= EB_QUEUE_LEN){
+            return 0;
+        }
+        n = MIN(nb, EB_QUEUE_LEN - total);
+    }while(!atomic_compare_exchange_weak_explicit(&inbox->total, &total, total + n,
+        memory_order_relaxed, memory_order_relaxed));
+
+    high = atomic_load_explicit(&inbox->high, memory_order_relaxed);
+    while(total + n > high && !atomic_compare_exchange_weak_explicit(&inbox->high, &high, total + n,
+        memory_order_relaxed, memory_order_relaxed));
+
+    return n;
+}
+
+// a blocked publisher announces itself in waiters before a last try, seq_cst
+// ordering makes sure it either finds the slot freed or is woken up
+static void eb_inbox_unreserve(eb_inbox_t *inbox, uint32_t nb)
+{
+    atomic_fetch_sub(&inbox->total, nb);
+    if(atomic_load(&inbox->waiters)){
+        eb_sem_give(&inbox->space);
+    }
+}
+
+static bool eb_inbox_pop(eb_inbox_t *inbox, uint32_t level, eb_msg_t *msg)
+{
+    bool found;
+
+    if(atomic_load_explicit(&inbox->depth[level], memory_order_relaxed) == 0){
+        return false;
+    }
+
+#if EB_USE_MPSC_RING
+    found = eb_ring_pop(&inbox->rings[level], msg);
+#else
+    found = eb_queue_get(&inbox->queues[level], msg, 0) == 0;
+#endif
+
+    if(found){
+        atomic_fetch_sub_explicit(&inbox->depth[level], 1, memory_order_relaxed);
+        eb_inbox_unreserve(inbox, 1);
+    }
+
+    return found;
+}
+
+// free a slot for a message of level, false when the policy has nothing
+// to evict
+static bool eb_inbox_evict(eb_inbox_t *inbox, uint32_t level, uint32_t policy)
+{
+    eb_msg_t msg;
+    uint32_t i = level;
+    bool found;
+
+    if(policy == EB_POLICY_DROP_LOWEST){
+        // never above the incoming message
+        for(i = 0 ; i < level && atomic_load_explicit(&inbox->depth[i], memory_order_relaxed) == 0 ; i++);
+    }
+
+    found = eb_inbox_pop(inbox, i, &msg);
+    if(found){
+        inbox->drop(inbox->drop_ctx, &msg);
+    }
+
+    return found;
+}
+
+// the physical push cannot fail once a slot is reserved
+static bool eb_inbox_put(eb_inbox_t *inbox, uint32_t level, const eb_msg_t *msg)
+{
+#if EB_USE_MPSC_RING
+    return eb_ring_push(&inbox->rings[level], msg);
+#else
+    return eb_queue_push(&inbox->queues[level], msg, EVENT_BUS_LOW_PRIO, 0) == 0;
+#endif
+}
+
+int32_t eb_inbox_push(eb_inbox_t *inbox, const eb_msg_t *msg, uint32_t prio, uint32_t policy, uint32_t timeout)
+{
+    uint32_t level = eb_inbox_level(prio);
+    uint32_t start = 0;
+    uint32_t ticks = 0;
+    uint32_t elapsed;
+    bool waiting = false;
+    int32_t rc = EVT_BUS_ERR_OK;
+
+    while(eb_inbox_reserve(inbox, 1) == 0){
+        if(policy == EB_POLICY_DROP_OLDEST || policy == EB_POLICY_DROP_LOWEST){
+            if(!eb_inbox_evict(inbox, level, policy)){
+                rc = EVT_BUS_PUB_ERR;
+                break;
+            }
+            continue;
+        }
+
+        if(policy == EB_POLICY_FAIL_FAST || timeout == 0){
+            rc = EVT_BUS_PUB_ERR;
+            break;
+        }
+
+        // slow path, wait for the dispatcher to free a slot. At least a
+        // tick: timeouts below the tick period round down to 0 ticks
+        if(!waiting){
+            start = eb_get_tick();
+            ticks = EB_MS_TO_TICK(timeout);
+            if(ticks == 0){
+                ticks = 1;
+            }
+            atomic_fetch_add(&inbox->waiters, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            waiting = true;
+            continue;
+        }
+
+        elapsed = eb_get_tick() - start;
+        if(elapsed >= ticks){
+            rc = EVT_BUS_PUB_ERR;
+            break;
+        }
+        eb_sem_take(&inbox->space, EB_TICK_TO_MS(ticks - elapsed));
+    }
+
+    // the semaphore is binary, wakeups given to several waiters at once
+    // collapse in one. A waiter served while slots are left passes it on
+    if(waiting && atomic_fetch_sub(&inbox->waiters, 1) > 1 && rc == EVT_BUS_ERR_OK &&
+        atomic_load_explicit(&inbox->total, memory_order_relaxed) < EB_QUEUE_LEN){
+        eb_sem_give(&inbox->space);
+    }
+
+    if(rc){
+        return rc;
+    }
+
+    // account the message first so the dispatcher never sees a negative depth
+    atomic_fetch_add_explicit(&inbox->depth[level], 1, memory_order_relaxed);
+
+    if(!eb_inbox_put(inbox, level, msg)){
+        atomic_fetch_sub_explicit(&inbox->depth[level], 1, memory_order_relaxed);
+        eb_inbox_unreserve(inbox, 1);
+        return EVT_BUS_PUB_ERR;
+    }
+
+    eb_inbox_wake(inbox);
+
+    return EVT_BUS_ERR_OK;
+}
+
+// queue what fits without waiting nor evicting, the caller applies the
+// policy of each event to the rest
+uint32_t eb_inbox_push_batch(eb_inbox_t *inbox, const eb_msg_t *msgs, uint32_t nb, uint32_t prio)
+{
+    uint32_t level = eb_inbox_level(prio);
+    uint32_t pushed = 0;
+    uint32_t n;
+
+    n = eb_inbox_reserve(inbox, nb);
+    if(n == 0){
+        return 0;
+    }
+
+    atomic_fetch_add_explicit(&inbox->depth[level], n, memory_order_relaxed);
+
+#if EB_USE_MPSC_RING
+    if(eb_ring_push_batch(&inbox->rings[level], msgs, n)){
+        pushed = n;
+    }
+#else
+    pushed = eb_queue_push_batch(&inbox->queues[level], msgs, n, EVENT_BUS_LOW_PRIO, 0);
+#endif
+    while(pushed < n && eb_inbox_put(inbox, level, &msgs[pushed])){
+        pushed++;
+    }
+
+    if(pushed < n){
+        atomic_fetch_sub_explicit(&inbox->depth[level], n - pushed, memory_order_relaxed);
+        eb_inbox_unreserve(inbox, n - pushed);
+    }
+
+    if(pushed > 0){
+        eb_inbox_wake(inbox);
+    }
+
+    return pushed;
+}
+
+static bool eb_inbox_try_get(eb_inbox_t *inbox, eb_msg_t *msg)
+{
+    uint32_t level;
+
+#ifdef EB_PRIO_WEIGHTS
+    // highest level with credits left first, once every busy level has used
+    // its credits they are all refilled
+    for(level = EB_NB_PRIO_LEVELS ; level-- > 0 ;){
+        if(inbox->credit[level] > 0 && eb_inbox_pop(inbox, level, msg)){
+            inbox->credit[level]--;
+            return true;
+        }
+    }
+
+    memcpy(inbox->credit, eb_prio_weights, sizeof(inbox->credit));
+#endif
+
+    for(level = EB_NB_PRIO_LEVELS ; level-- > 0 ;){
+        if(eb_inbox_pop(inbox, level, msg)){
+#ifdef EB_PRIO_WEIGHTS
+            inbox->credit[level]--;
+#endif
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int32_t eb_inbox_get(eb_inbox_t *inbox, eb_msg_t *msg, uint32_t timeout)
+{
+    bool found;
+
+    found = eb_inbox_try_get(inbox, msg);
+    if(!found && timeout > 0){
+        // pairs with the fence of eb_inbox_wake, the levels are read
+        // relaxed and would not be ordered after the store without it
+        atomic_store(&inbox->sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        found = eb_inbox_try_get(inbox, msg);
+        if(!found && !atomic_exchange(&inbox->kicked, 0)){
+            eb_sem_take(&inbox->wake, timeout);
+            found = eb_inbox_try_get(inbox, msg);
+        }
+        atomic_store(&inbox->sleeping, 0);
+    }
+
+    return found ? 0 : -1;
+}
+
+uint32_t eb_inbox_depth(eb_inbox_t *inbox, uint32_t prio)
+{
+    return atomic_load_explicit(&inbox->depth[eb_inbox_level(prio)], memory_order_relaxed);
+}
+
+uint32_t eb_inbox_high_watermark(eb_inbox_t *inbox)
+{
+    return atomic_load_explicit(&inbox->high, memory_order_relaxed);
+}
+
+// have eb_inbox_get return without a message, at the latest once the
+// dispatcher goes back to sleep
+void eb_inbox_kick(eb_inbox_t *inbox)
+{
+    atomic_store(&inbox->kicked, 1);
+    eb_inbox_wake(inbox);
+}
@@ -0,0 +1,119 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include <string.h>
+#include "event_bus_lookup.h"
+#include "event_bus_err.h"
+
+#if EB_EVT_LOOKUP == EB_EVT_LOOKUP_HASH
+
+#define EB_LOOKUP_MASK              (EB_EVT_LOOKUP_SIZE - 1)
+
+static inline uint32_t eb_lookup_hash(uint32_t id)
+{
+    // ids are often allocated per module in the upper bits, mix them down
+    id *= 0x9E3779B1U;
+    return (id ^ (id >> 16)) & EB_LOOKUP_MASK;
+}
+
+void eb_lookup_init(eb_lookup_t *tbl)
+{
+    memset(tbl, 0, sizeof(eb_lookup_t));
+}
+
+int32_t eb_lookup_insert(eb_lookup_t *tbl, uint32_t id, uint32_t index)
+{
+    uint32_t i;
+    uint32_t h = eb_lookup_hash(id);
+    eb_lookup_slot_t *slot;
+
+    for(i = 0 ; i < EB_EVT_LOOKUP_SIZE ; i++){
+        slot = &tbl->slots[(h + i) & EB_LOOKUP_MASK];
+        if(atomic_load_explicit(&slot->ref, memory_order_relaxed) == 0){
+            // the id must be visible before the slot is marked as used
+            slot->id = id;
+            atomic_store_explicit(&slot->ref, index + 1, memory_order_release);
+            return EVT_BUS_ERR_OK;
+        }
+    }
+
+    return EVT_BUS_MEM_ERR;
+}
+
+int32_t eb_lookup_find(eb_lookup_t *tbl, uint32_t id)
+{
+    uint32_t i;
+    uint32_t ref;
+    uint32_t h = eb_lookup_hash(id);
+    eb_lookup_slot_t *slot;
+
+    for(i = 0 ; i < EB_EVT_LOOKUP_SIZE ; i++){
+        slot = &tbl->slots[(h + i) & EB_LOOKUP_MASK];
+        ref = atomic_load_explicit(&slot->ref, memory_order_acquire);
+        if(ref == 0){
+            break;
+        }
+        if(slot->id == id){
+            return (int32_t)(ref - 1);
+        }
+    }
+
+    return -1;
+}
+
+#elif EB_EVT_LOOKUP == EB_EVT_LOOKUP_DIRECT
+
+void eb_lookup_init(eb_lookup_t *tbl)
+{
+    memset(tbl, 0, sizeof(eb_lookup_t));
+}
+
+int32_t eb_lookup_insert(eb_lookup_t *tbl, uint32_t id, uint32_t index)
+{
+    if(id >= EB_EVT_DIRECT_MAX_ID){
+        return EVT_BUS_MEM_ERR;
+    }
+
+    tbl->slots[id].id = id;
+    atomic_store_explicit(&tbl->slots[id].ref, index + 1, memory_order_release);
+
+    return EVT_BUS_ERR_OK;
+}
+
+int32_t eb_lookup_find(eb_lookup_t *tbl, uint32_t id)
+{
+    if(id >= EB_EVT_DIRECT_MAX_ID){
+        return -1;
+    }
+
+    return (int32_t)atomic_load_explicit(&tbl->slots[id].ref, memory_order_acquire) - 1;
+}
+
+#endif
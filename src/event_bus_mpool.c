@@ -0,0 +1,195 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "event_bus_mpool.h"
+#include "event_bus_stats.h"
+
+// blocks are kept 8 bytes aligned so any payload type can be stored in them
+#define EB_MPOOL_ALIGN(size)        (((size) + 7U) & ~7U)
+#define EB_MPOOL_WORDS(size, count) ((EB_MPOOL_ALIGN(size) / 8U) * (count) + 1U)
+
+typedef struct eb_mpool_blk_t
+{
+    struct eb_mpool_blk_t *next;
+}eb_mpool_blk_t;
+
+typedef struct eb_mpool_class_t
+{
+    uint8_t *base;
+    uint8_t *end;
+    uint32_t blk_size;
+    eb_mpool_blk_t *free_list;
+    eb_mpool_stats_t stats;
+}eb_mpool_class_t;
+
+static uint64_t mpool_mem0[EB_MPOOL_WORDS(EB_MPOOL_CLASS0_SIZE + EB_MPOOL_HDR_LEN, EB_MPOOL_CLASS0_COUNT)];
+static uint64_t mpool_mem1[EB_MPOOL_WORDS(EB_MPOOL_CLASS1_SIZE + EB_MPOOL_HDR_LEN, EB_MPOOL_CLASS1_COUNT)];
+static uint64_t mpool_mem2[EB_MPOOL_WORDS(EB_MPOOL_CLASS2_SIZE + EB_MPOOL_HDR_LEN, EB_MPOOL_CLASS2_COUNT)];
+
+static eb_mpool_class_t mpool[EB_MPOOL_NB_CLASS];
+static bool mpool_ready = false;
+
+static void eb_mpool_class_init(eb_mpool_class_t *cls, uint64_t *mem, uint32_t size, uint32_t count)
+{
+    uint32_t i;
+    eb_mpool_blk_t *blk;
+
+    memset(cls, 0, sizeof(eb_mpool_class_t));
+    cls->blk_size = EB_MPOOL_ALIGN(size + EB_MPOOL_HDR_LEN);
+    cls->base = (uint8_t *)mem;
+    cls->end = cls->base + cls->blk_size * count;
+    cls->stats.size = size;
+    cls->stats.count = count;
+
+    // thread every block on the free list, lowest address first
+    for(i = count ; i > 0 ; i--){
+        blk = (eb_mpool_blk_t *)(cls->base + cls->blk_size * (i - 1));
+        blk->next = cls->free_list;
+        cls->free_list = blk;
+    }
+}
+
+int32_t eb_mpool_init(void)
+{
+    uint32_t state;
+
+    state = eb_enter_critical();
+    if(!mpool_ready){
+        eb_mpool_class_init(&mpool[0], mpool_mem0, EB_MPOOL_CLASS0_SIZE, EB_MPOOL_CLASS0_COUNT);
+        eb_mpool_class_init(&mpool[1], mpool_mem1, EB_MPOOL_CLASS1_SIZE, EB_MPOOL_CLASS1_COUNT);
+        eb_mpool_class_init(&mpool[2], mpool_mem2, EB_MPOOL_CLASS2_SIZE, EB_MPOOL_CLASS2_COUNT);
+        mpool_ready = true;
+    }
+    eb_exit_critical(state);
+
+    return EVT_BUS_ERR_OK;
+}
+
+int32_t eb_mpool_alloc(uint32_t len, void **block)
+{
+    uint32_t i;
+    uint32_t state;
+    bool fits = false;
+    eb_mpool_class_t *cls;
+    eb_mpool_blk_t *blk = NULL;
+
+    *block = NULL;
+
+    // take the first free block of the smallest class able to hold len,
+    // bigger classes are used when the best fitting one is exhausted
+    state = eb_enter_critical();
+    for(i = 0 ; i < EB_MPOOL_NB_CLASS ; i++){
+        cls = &mpool[i];
+        if(cls->stats.count == 0 || cls->stats.size + EB_MPOOL_HDR_LEN < len){
+            continue;
+        }
+
+        if(!fits){
+            fits = true;
+            if(cls->free_list == NULL){
+                cls->stats.fail++;
+            }
+        }
+
+        if(cls->free_list != NULL){
+            blk = cls->free_list;
+            cls->free_list = blk->next;
+            cls->stats.used++;
+            if(cls->stats.used > cls->stats.peak){
+                cls->stats.peak = cls->stats.used;
+            }
+            break;
+        }
+    }
+    eb_exit_critical(state);
+
+    if(blk != NULL){
+        eb_stats_add_alloc(EB_STATS_ALLOC_POOL);
+        *block = blk;
+        return EVT_BUS_ERR_OK;
+    }
+
+    if(fits){
+        return EVT_BUS_POOL_ERR;
+    }
+
+#if EB_MPOOL_HEAP_FALLBACK
+    *block = eb_malloc(len);
+    if(*block == NULL){
+        return EVT_BUS_ALLOC_ERR;
+    }
+    eb_stats_add_alloc(EB_STATS_ALLOC_HEAP);
+    return EVT_BUS_ERR_OK;
+#else
+    return EVT_BUS_POOL_ERR;
+#endif
+}
+
+void eb_mpool_free(void *block)
+{
+    uint32_t i;
+    uint32_t state;
+    eb_mpool_class_t *cls;
+    eb_mpool_blk_t *blk = (eb_mpool_blk_t *)block;
+
+    if(block == NULL){
+        return;
+    }
+
+    for(i = 0 ; i < EB_MPOOL_NB_CLASS ; i++){
+        cls = &mpool[i];
+        if((uint8_t *)block >= cls->base && (uint8_t *)block < cls->end){
+            state = eb_enter_critical();
+            blk->next = cls->free_list;
+            cls->free_list = blk;
+            cls->stats.used--;
+            eb_exit_critical(state);
+            return;
+        }
+    }
+
+    // not a pool block, it has been allocated by the heap fallback
+    eb_free(block);
+}
+
+int32_t eb_mpool_get_stats(uint32_t class_id, eb_mpool_stats_t *stats)
+{
+    uint32_t state;
+
+    if(class_id >= EB_MPOOL_NB_CLASS){
+        return EVT_BUS_POOL_ERR;
+    }
+
+    state = eb_enter_critical();
+    memcpy(stats, &mpool[class_id].stats, sizeof(eb_mpool_stats_t));
+    eb_exit_critical(state);
+
+    return EVT_BUS_ERR_OK;
+}
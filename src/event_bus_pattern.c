@@ -0,0 +1,254 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "event_bus_pattern.h"
+#include "event_bus_subs.h"
+#include "event_bus_inbox.h"
+
+// ranges matched by value/mask, the trailing don't care bits make a range,
+// every combination of the other don't care bits adds one
+int32_t eb_pat_split(uint32_t value, uint32_t mask, eb_pat_t *pats, uint32_t max)
+{
+    uint32_t low;
+    uint32_t free_bits;
+    uint32_t nb;
+    uint32_t n;
+    uint32_t bit;
+    uint32_t spread;
+    uint32_t i;
+
+    low = mask == 0 ? UINT32_MAX : (mask & (~mask + 1)) - 1;
+    free_bits = ~mask & ~low;
+    nb = 1U << __builtin_popcount(free_bits);
+    if(free_bits != 0 && nb > max){
+        return -1;
+    }
+
+    for(n = 0 ; n < nb ; n++){
+        // deposit the bits of n into the free bit positions
+        spread = 0;
+        bit = 0;
+        for(i = 0 ; i < 32 ; i++){
+            if(free_bits & (1U << i)){
+                if(n & (1U << bit)){
+                    spread |= 1U << i;
+                }
+                bit++;
+            }
+        }
+
+        memset(&pats[n], 0, sizeof(eb_pat_t));
+        pats[n].lo = (value & mask) | spread;
+        pats[n].hi = pats[n].lo | low;
+    }
+
+    return (int32_t)nb;
+}
+
+static void eb_pat_idx_free(eb_pat_idx_t *idx)
+{
+    uint32_t i;
+
+    for(i = 0 ; i < idx->nb_seg ; i++){
+        eb_sub_tbl_release(idx->segs[i].subs);
+    }
+    eb_free(idx);
+}
+
+// compile the patterns into disjoint segments, bounds are every first id
+// and every id following a last one
+static eb_pat_idx_t *eb_pat_idx_build(const eb_pat_t *pats, uint32_t nb_pat)
+{
+    uint64_t bounds[2 * EB_MAX_PATTERNS];
+    uint64_t tmp;
+    uint32_t nb_bound = 0;
+    uint32_t i;
+    uint32_t j;
+    uint32_t count;
+    eb_pat_idx_t *idx;
+    eb_pat_seg_t *seg;
+
+    for(i = 0 ; i < nb_pat ; i++){
+        bounds[nb_bound++] = pats[i].lo;
+        bounds[nb_bound++] = (uint64_t)pats[i].hi + 1;
+    }
+
+    for(i = 1 ; i < nb_bound ; i++){
+        tmp = bounds[i];
+        for(j = i ; j > 0 && bounds[j - 1] > tmp ; j--){
+            bounds[j] = bounds[j - 1];
+        }
+        bounds[j] = tmp;
+    }
+
+    for(i = 0, j = 0 ; i < nb_bound ; i++){
+        if(j == 0 || bounds[i] != bounds[j - 1]){
+            bounds[j++] = bounds[i];
+        }
+    }
+    nb_bound = j;
+
+    idx = eb_malloc(sizeof(eb_pat_idx_t) + nb_pat * sizeof(eb_pat_t) + (nb_bound > 0 ? nb_bound - 1 : 0) * sizeof(eb_pat_seg_t));
+    if(idx == NULL){
+        return NULL;
+    }
+
+    memset(idx, 0, sizeof(eb_pat_idx_t));
+    idx->nb_pat = nb_pat;
+    idx->pats = (eb_pat_t *)(idx + 1);
+    idx->segs = (eb_pat_seg_t *)(idx->pats + nb_pat);
+    memcpy(idx->pats, pats, nb_pat * sizeof(eb_pat_t));
+
+    for(i = 0 ; i + 1 < nb_bound ; i++){
+        count = 0;
+        for(j = 0 ; j < nb_pat ; j++){
+            if(pats[j].lo <= bounds[i] && bounds[i] <= pats[j].hi){
+                count++;
+            }
+        }
+
+        if(count == 0){
+            continue;
+        }
+
+        seg = &idx->segs[idx->nb_seg];
+        seg->lo = (uint32_t)bounds[i];
+        seg->hi = (uint32_t)(bounds[i + 1] - 1);
+        seg->subs = eb_sub_tbl_new(NULL, count);
+        if(seg->subs == NULL){
+            eb_pat_idx_free(idx);
+            return NULL;
+        }
+        idx->nb_seg++;
+
+        count = 0;
+        for(j = 0 ; j < nb_pat ; j++){
+            if(pats[j].lo <= bounds[i] && bounds[i] <= pats[j].hi){
+                memcpy(&seg->subs->subs[count++], &pats[j].sub, sizeof(eb_sub_t));
+            }
+        }
+    }
+
+    return idx;
+}
+
+// patterns of idx without those of remove, followed by the nb_pat new ones
+eb_pat_idx_t *eb_pat_idx_new(const eb_pat_idx_t *idx, const eb_pat_t *pats, uint32_t nb_pat, eb_sub_cb_t *remove)
+{
+    eb_pat_t all[EB_MAX_PATTERNS];
+    uint32_t nb = 0;
+    uint32_t i;
+
+    for(i = 0 ; idx != NULL && i < idx->nb_pat ; i++){
+        if(idx->pats[i].sub.cb != remove){
+            memcpy(&all[nb++], &idx->pats[i], sizeof(eb_pat_t));
+        }
+    }
+
+    if(nb + nb_pat > EB_MAX_PATTERNS){
+        return NULL;
+    }
+
+    memcpy(&all[nb], pats, nb_pat * sizeof(eb_pat_t));
+    nb += nb_pat;
+
+    return eb_pat_idx_build(all, nb);
+}
+
+eb_sub_tbl_t *eb_pat_idx_find(const eb_pat_idx_t *idx, uint32_t event_id)
+{
+    uint32_t lo = 0;
+    uint32_t hi;
+    uint32_t mid;
+
+    if(idx == NULL){
+        return NULL;
+    }
+
+    hi = idx->nb_seg;
+    while(lo < hi){
+        mid = (lo + hi) / 2;
+        if(event_id < idx->segs[mid].lo){
+            hi = mid;
+        }else if(event_id > idx->segs[mid].hi){
+            lo = mid + 1;
+        }else{
+            return idx->segs[mid].subs;
+        }
+    }
+
+    return NULL;
+}
+
+static void eb_pat_idx_push(eb_t *bus, eb_pat_idx_t *idx)
+{
+    eb_pat_idx_t *head;
+
+    head = atomic_load_explicit(&bus->retired_pat, memory_order_relaxed);
+    do{
+        idx->next = head;
+    }while(!atomic_compare_exchange_weak_explicit(&bus->retired_pat, &head, idx,
+        memory_order_release, memory_order_relaxed));
+}
+
+// same scheme as eb_sub_tbl_retire, segment tables may outlive the index in
+// workers
+void eb_pat_idx_retire(eb_t *bus, eb_pat_idx_t *idx)
+{
+    if(idx == NULL){
+        return;
+    }
+
+    idx->epoch = eb_epoch_retire(bus);
+    eb_pat_idx_push(bus, idx);
+
+    eb_inbox_kick(&bus->shards[0].inbox);
+}
+
+void eb_pat_idx_reclaim(eb_t *bus)
+{
+    eb_pat_idx_t *idx;
+    eb_pat_idx_t *next;
+
+    if(atomic_load_explicit(&bus->retired_pat, memory_order_relaxed) == NULL){
+        return;
+    }
+
+    idx = atomic_exchange_explicit(&bus->retired_pat, NULL, memory_order_acquire);
+    while(idx != NULL){
+        next = idx->next;
+        if(eb_epoch_passed(bus, idx->epoch)){
+            eb_pat_idx_free(idx);
+        }else{
+            eb_pat_idx_push(bus, idx);
+        }
+        idx = next;
+    }
+}
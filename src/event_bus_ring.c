@@ -0,0 +1,155 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "event_bus_ring.h"
+
+#if EB_USE_MPSC_RING
+
+// Bounded multi-producer ring, each cell carries a sequence number telling
+// whether it is free for the lap a publisher reserved (seq == pos) or
+// holds a committed message (seq == pos + 1). Publishers evicting a message
+// pop alongside the dispatcher so the read side is multi-consumer too.
+
+#define EB_RING_MASK                (EB_RING_LEN - 1)
+
+void eb_ring_init(eb_ring_t *ring)
+{
+    uint32_t i;
+
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->head, 0);
+
+    for(i = 0 ; i < EB_RING_LEN ; i++){
+        atomic_init(&ring->cells[i].seq, i);
+    }
+}
+
+bool eb_ring_push(eb_ring_t *ring, const eb_msg_t *msg)
+{
+    eb_ring_cell_t *cell;
+    uint32_t pos;
+    int32_t diff;
+
+    pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while(1){
+        cell = &ring->cells[pos & EB_RING_MASK];
+        diff = (int32_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - pos);
+        if(diff == 0){
+            // reserve
+            if(atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed)){
+                break;
+            }
+        }else if(diff < 0){
+            // the previous lap has not been read yet, ring is full
+            return false;
+        }else{
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    // commit
+    memcpy(&cell->msg, msg, sizeof(eb_msg_t));
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    return true;
+}
+
+// reserve nb consecutive cells at once. Consumers may free cells out of
+// order, every cell is checked. A free cell stays free until the tail
+// moves past it so the check holds when the reservation succeeds
+bool eb_ring_push_batch(eb_ring_t *ring, const eb_msg_t *msgs, uint32_t nb)
+{
+    eb_ring_cell_t *cell;
+    uint32_t pos;
+    uint32_t i;
+    int32_t diff;
+
+    if(nb == 0 || nb > EB_RING_LEN){
+        return false;
+    }
+
+    pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while(1){
+        for(i = 0, diff = 0 ; i < nb && diff == 0 ; i++){
+            cell = &ring->cells[(pos + i) & EB_RING_MASK];
+            diff = (int32_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - (pos + i));
+        }
+        if(diff == 0){
+            if(atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + nb,
+                memory_order_relaxed, memory_order_relaxed)){
+                break;
+            }
+        }else if(diff < 0){
+            return false;
+        }else{
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+
+    for(i = 0 ; i < nb ; i++){
+        cell = &ring->cells[(pos + i) & EB_RING_MASK];
+        memcpy(&cell->msg, &msgs[i], sizeof(eb_msg_t));
+        atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release);
+    }
+
+    return true;
+}
+
+bool eb_ring_pop(eb_ring_t *ring, eb_msg_t *msg)
+{
+    eb_ring_cell_t *cell;
+    uint32_t pos;
+    int32_t diff;
+
+    pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while(1){
+        cell = &ring->cells[pos & EB_RING_MASK];
+        diff = (int32_t)(atomic_load_explicit(&cell->seq, memory_order_acquire) - (pos + 1));
+        if(diff == 0){
+            if(atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed)){
+                break;
+            }
+        }else if(diff < 0){
+            // not committed yet, ring is empty
+            return false;
+        }else{
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    memcpy(msg, &cell->msg, sizeof(eb_msg_t));
+    atomic_store_explicit(&cell->seq, pos + EB_RING_LEN, memory_order_release);
+
+    return true;
+}
+
+#endif
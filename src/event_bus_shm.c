@@ -0,0 +1,433 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+#include "event_bus_shm.h"
+
+#if EB_USE_SHM
+
+#ifndef __linux__
+#error "EB_USE_SHM needs Linux futexes"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#if (EB_SHM_RING_LEN & (EB_SHM_RING_LEN - 1)) != 0
+#error "EB_SHM_RING_LEN must be a power of 2"
+#endif
+
+#define EB_SHM_MASK                 (EB_SHM_RING_LEN - 1)
+
+// same protocol as eb_ring_t: a slot is free for the lap of pos when
+// seq == pos and holds a committed message when seq == pos + 1. There is a
+// single reader, head is only written by the receiving thread
+typedef struct eb_shm_slot_t
+{
+    atomic_uint seq;
+    uint32_t pos;                               // lap reserved by eb_shm_alloc
+    uint32_t evt_id;
+    uint32_t len;
+    uint32_t prio;
+    uint32_t pub_ns;                            // low 32 bits of eb_get_time_ns() of the publisher
+    _Alignas(8) uint8_t data[EB_SHM_MSG_LEN];
+}eb_shm_slot_t;
+
+typedef struct eb_shm_ring_t
+{
+    atomic_uint magic;                          // stored last by the creator
+    uint32_t version;
+    uint32_t nb_slots;
+    uint32_t slot_size;
+    _Alignas(EB_CACHE_LINE) atomic_uint tail;   // next slot reserved by publishers
+    _Alignas(EB_CACHE_LINE) atomic_uint head;   // next slot read by the receiver
+    atomic_uint sleeping;                       // receiver waits on wake
+    atomic_uint wake;                           // futex, bumped to wake the receiver
+    _Alignas(EB_CACHE_LINE) atomic_uint waiters; // publishers wait on space
+    atomic_uint space;                          // futex, bumped when slots are freed
+    _Alignas(EB_CACHE_LINE) eb_shm_slot_t slots[EB_SHM_RING_LEN];
+}eb_shm_ring_t;
+
+// futex words are shared between processes, no FUTEX_PRIVATE_FLAG
+static void eb_futex_wait(atomic_uint *addr, uint32_t val, uint32_t timeout)
+{
+    struct timespec ts;
+
+    if(timeout != EB_WAIT_FOREVER){
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long)(timeout % 1000) * 1000000L;
+    }
+
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT, val, timeout != EB_WAIT_FOREVER ? &ts : NULL, NULL, 0);
+}
+
+static void eb_futex_wake(atomic_uint *addr, int nb)
+{
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE, nb, NULL, NULL, 0);
+}
+
+static eb_shm_ring_t *eb_shm_map(int fd)
+{
+    void *addr = mmap(NULL, sizeof(eb_shm_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    return addr != MAP_FAILED ? (eb_shm_ring_t *)addr : NULL;
+}
+
+static eb_shm_slot_t *eb_shm_reserve(eb_shm_ring_t *ring)
+{
+    eb_shm_slot_t *slot;
+    uint32_t pos;
+    int32_t diff;
+
+    pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while(1){
+        slot = &ring->slots[pos & EB_SHM_MASK];
+        diff = (int32_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+        if(diff == 0){
+            if(atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed)){
+                slot->pos = pos;
+                return slot;
+            }
+        }else if(diff < 0){
+            // the previous lap has not been read yet, ring is full
+            return NULL;
+        }else{
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+}
+
+// waits on the space futex between tries. The receiver bumps it after
+// freeing slots when it sees a waiter, the fences make sure that either the
+// waiter sees the free slot or the receiver sees the waiter
+static eb_shm_slot_t *eb_shm_reserve_wait(eb_shm_ring_t *ring, uint32_t timeout)
+{
+    eb_shm_slot_t *slot;
+    uint64_t end = eb_get_time_ns() + (uint64_t)timeout * 1000000ULL;
+    uint64_t now;
+    uint32_t space;
+
+    slot = eb_shm_reserve(ring);
+    while(slot == NULL && timeout > 0){
+        space = atomic_load_explicit(&ring->space, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ring->waiters, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        slot = eb_shm_reserve(ring);
+        now = eb_get_time_ns();
+        if(slot == NULL && now < end){
+            eb_futex_wait(&ring->space, space, (uint32_t)((end - now + 999999ULL) / 1000000ULL));
+            slot = eb_shm_reserve(ring);
+        }
+        atomic_fetch_sub_explicit(&ring->waiters, 1, memory_order_relaxed);
+
+        if(slot == NULL && eb_get_time_ns() >= end){
+            break;
+        }
+    }
+
+    return slot;
+}
+
+static void eb_shm_commit_slot(eb_shm_ring_t *ring, eb_shm_slot_t *slot)
+{
+    atomic_store_explicit(&slot->seq, slot->pos + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&ring->sleeping, memory_order_relaxed)){
+        atomic_fetch_add_explicit(&ring->wake, 1, memory_order_relaxed);
+        eb_futex_wake(&ring->wake, 1);
+    }
+}
+
+static eb_shm_slot_t *eb_shm_peek(eb_shm_ring_t *ring, uint32_t pos)
+{
+    eb_shm_slot_t *slot = &ring->slots[pos & EB_SHM_MASK];
+
+    if(atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1){
+        return NULL;
+    }
+
+    return slot;
+}
+
+// the payload is copied once by eb_pub_at, in the message or a pool buffer.
+// While the pool is empty the slot is kept, the ring fills up and remote
+// publishers wait instead of losing the event
+static int32_t eb_shm_relay(eb_shm_t *shm, eb_shm_slot_t *slot, uint32_t evt_id, uint32_t len, uint32_t prio)
+{
+    uint64_t end = eb_get_time_ns() + (uint64_t)shm->bus->pub_timeout * 1000000ULL;
+    int32_t rc;
+
+    while(1){
+        rc = eb_pub_at(shm->bus, evt_id, len > 0 ? slot->data : NULL, len, prio, slot->pub_ns);
+        if(rc != EVT_BUS_POOL_ERR || eb_get_time_ns() >= end || atomic_load_explicit(&shm->stop, memory_order_acquire)){
+            return rc;
+        }
+        usleep(100);
+    }
+}
+
+static void eb_shm_thread(void *arg)
+{
+    eb_shm_t *shm = (eb_shm_t *)arg;
+    eb_shm_ring_t *ring = shm->ring;
+    eb_shm_slot_t *slot;
+    uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t wake;
+    uint32_t evt_id;
+    uint32_t len;
+    uint32_t prio;
+    int32_t rc;
+
+    while(!atomic_load_explicit(&shm->stop, memory_order_acquire)){
+        slot = eb_shm_peek(ring, pos);
+        if(slot == NULL){
+            wake = atomic_load_explicit(&ring->wake, memory_order_relaxed);
+            atomic_store_explicit(&ring->sleeping, 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            if(eb_shm_peek(ring, pos) == NULL && !atomic_load_explicit(&shm->stop, memory_order_acquire)){
+                eb_futex_wait(&ring->wake, wake, EB_WAIT_FOREVER);
+            }
+            atomic_store_explicit(&ring->sleeping, 0, memory_order_relaxed);
+            continue;
+        }
+
+        // any process mapping the ring can write the slot, each field is
+        // read once and checked before the payload is copied
+        evt_id = slot->evt_id;
+        len = slot->len;
+        prio = slot->prio;
+        if(len > EB_SHM_MSG_LEN || prio >= EB_NB_PRIO_LEVELS){
+            eb_log_err("drop malformed message from %s, len %lu prio %lu\n", shm->name, len, prio);
+        }else{
+            rc = eb_shm_relay(shm, slot, evt_id, len, prio);
+            if(rc){
+                eb_log_err("failed to relay event id 0x%lx from %s (%ld)\n", evt_id, shm->name, rc);
+            }
+        }
+
+        atomic_store_explicit(&slot->seq, pos + EB_SHM_RING_LEN, memory_order_release);
+        pos++;
+        atomic_store_explicit(&ring->head, pos, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_seq_cst);
+        if(atomic_load_explicit(&ring->waiters, memory_order_relaxed)){
+            atomic_fetch_add_explicit(&ring->space, 1, memory_order_relaxed);
+            eb_futex_wake(&ring->space, INT_MAX);
+        }
+    }
+
+    atomic_store_explicit(&shm->done, 1, memory_order_release);
+    eb_futex_wake(&shm->done, 1);
+}
+
+int32_t eb_shm_create(eb_shm_t *shm, eb_t *bus, const char *name)
+{
+    eb_shm_ring_t *ring;
+    uint32_t i;
+    int fd;
+
+    if(shm == NULL || bus == NULL || name == NULL || strlen(name) >= EB_SHM_NAME_MAX_LEN){
+        return EVT_BUS_SHM_ERR;
+    }
+
+    memset(shm, 0, sizeof(eb_shm_t));
+    strcpy(shm->name, name);
+    shm->bus = bus;
+
+    // publishers still attached to a former ring keep the old object
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, EB_SHM_MODE);
+    if(fd < 0){
+        eb_log_err("shm_open %s failed (%d)\n", name, errno);
+        return EVT_BUS_SHM_ERR;
+    }
+
+    if(ftruncate(fd, sizeof(eb_shm_ring_t))){
+        close(fd);
+        shm_unlink(name);
+        return EVT_BUS_SHM_ERR;
+    }
+
+    ring = eb_shm_map(fd);
+    close(fd);
+    if(ring == NULL){
+        shm_unlink(name);
+        return EVT_BUS_SHM_ERR;
+    }
+
+    // the object is zero filled
+    ring->version = EB_SHM_VERSION;
+    ring->nb_slots = EB_SHM_RING_LEN;
+    ring->slot_size = sizeof(eb_shm_slot_t);
+    for(i = 0 ; i < EB_SHM_RING_LEN ; i++){
+        atomic_store_explicit(&ring->slots[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store_explicit(&ring->magic, EB_SHM_MAGIC, memory_order_release);
+    shm->ring = ring;
+
+    shm->thread = eb_thread_new("eb_shm", eb_shm_thread, (void *)shm, EB_STACK_SIZE, EB_PRIO);
+    if(shm->thread == NULL){
+        eb_shm_close(shm);
+        return EVT_BUS_THREAD_ERR;
+    }
+
+    return EVT_BUS_ERR_OK;
+}
+
+int32_t eb_shm_open(eb_shm_t *shm, const char *name)
+{
+    eb_shm_ring_t *ring;
+    struct stat st;
+    int fd;
+
+    if(shm == NULL || name == NULL || strlen(name) >= EB_SHM_NAME_MAX_LEN){
+        return EVT_BUS_SHM_ERR;
+    }
+
+    memset(shm, 0, sizeof(eb_shm_t));
+    strcpy(shm->name, name);
+
+    fd = shm_open(name, O_RDWR, 0);
+    if(fd < 0){
+        return errno == ENOENT ? EVT_BUS_NOT_FOUND_ERR : EVT_BUS_SHM_ERR;
+    }
+
+    // the creator may not have sized it yet
+    if(fstat(fd, &st) || (size_t)st.st_size < sizeof(eb_shm_ring_t)){
+        close(fd);
+        return EVT_BUS_NOT_FOUND_ERR;
+    }
+
+    ring = eb_shm_map(fd);
+    close(fd);
+    if(ring == NULL){
+        return EVT_BUS_SHM_ERR;
+    }
+
+    if(atomic_load_explicit(&ring->magic, memory_order_acquire) != EB_SHM_MAGIC){
+        munmap(ring, sizeof(eb_shm_ring_t));
+        return EVT_BUS_NOT_FOUND_ERR;
+    }
+
+    if(ring->version != EB_SHM_VERSION || ring->nb_slots != EB_SHM_RING_LEN || ring->slot_size != sizeof(eb_shm_slot_t)){
+        eb_log_err("%s was built with another ring layout\n", name);
+        munmap(ring, sizeof(eb_shm_ring_t));
+        return EVT_BUS_SHM_ERR;
+    }
+    shm->ring = ring;
+
+    return EVT_BUS_ERR_OK;
+}
+
+void eb_shm_close(eb_shm_t *shm)
+{
+    if(shm == NULL || shm->ring == NULL){
+        return;
+    }
+
+    if(shm->thread != NULL){
+        atomic_store_explicit(&shm->stop, true, memory_order_release);
+        atomic_fetch_add_explicit(&shm->ring->wake, 1, memory_order_relaxed);
+        eb_futex_wake(&shm->ring->wake, 1);
+        // let the thread leave eb_pub_at before it is deleted
+        while(!atomic_load_explicit(&shm->done, memory_order_acquire)){
+            eb_futex_wait(&shm->done, 0, EB_WAIT_FOREVER);
+        }
+        eb_thread_delete(shm->thread);
+        shm->thread = NULL;
+    }
+
+    if(shm->bus != NULL){
+        shm_unlink(shm->name);
+    }
+
+    munmap(shm->ring, sizeof(eb_shm_ring_t));
+    shm->ring = NULL;
+}
+
+int32_t eb_shm_alloc(eb_shm_t *shm, uint32_t len, void **data)
+{
+    eb_shm_slot_t *slot;
+
+    if(shm == NULL || shm->ring == NULL || data == NULL || len > EB_SHM_MSG_LEN){
+        return EVT_BUS_SHM_ERR;
+    }
+
+    slot = eb_shm_reserve_wait(shm->ring, EB_SHM_PUB_TIMEOUT);
+    if(slot == NULL){
+        return EVT_BUS_PUB_ERR;
+    }
+
+    slot->len = len;
+    *data = slot->data;
+
+    return EVT_BUS_ERR_OK;
+}
+
+void eb_shm_commit(eb_shm_t *shm, void *data, uint32_t event_id, uint32_t prio)
+{
+    eb_shm_slot_t *slot = (eb_shm_slot_t *)((uint8_t *)data - offsetof(eb_shm_slot_t, data));
+
+    slot->evt_id = event_id;
+    slot->prio = MIN(prio, EB_NB_PRIO_LEVELS - 1);
+    slot->pub_ns = (uint32_t)eb_get_time_ns();
+    eb_shm_commit_slot(shm->ring, slot);
+}
+
+int32_t eb_shm_pub(eb_shm_t *shm, uint32_t event_id, const void *data, uint32_t len, uint32_t prio)
+{
+    void *buf;
+    int32_t rc;
+
+    rc = eb_shm_alloc(shm, len, &buf);
+    if(rc){
+        return rc;
+    }
+
+    if(len > 0){
+        memcpy(buf, data, len);
+    }
+    eb_shm_commit(shm, buf, event_id, prio);
+
+    return EVT_BUS_ERR_OK;
+}
+
+#endif
@@ -28,67 +28,335 @@
  * WITH THE SOFTWARE.
  */
 
+#include <stddef.h>
 #include "event_bus_stats.h"
 
-static eb_hist_t stat_hist[EB_STAT_HIST_DEPTH];
 static eb_stats_t stats;
 
+// histograms are static and start empty, a bus init keeps the samples
+// recorded by the other buses
 int32_t eb_stats_init(eb_t *bus)
 {
-    memset(&stats, 0, sizeof(eb_stats_t));
-    memset(stat_hist, 0, sizeof(eb_hist_t)*EB_STAT_HIST_DEPTH);
+    (void)bus;
 
     return 0;
 }
 
-int32_t eb_stats_add(eb_t *bus, const char *name, uint32_t event_id, uint32_t latency)
+static inline eb_stats_shard_t *eb_stats_shard(void)
 {
-    strcpy((char *)stat_hist[stats.index].name, name);
-    stat_hist[stats.index].lat = latency;
-    stat_hist[stats.index].event_id = event_id;
+    return &stats.shards[eb_thread_index() % EB_STATS_NB_SHARDS];
+}
 
-    if(stats.lat_min == 0 && stats.lat_avg == 0 && stats.lat_max == 0)
-    {
-        stats.lat_min = latency;
-        stats.lat_avg = latency;
-        stats.lat_max = latency;
-    }else
-    {
-        if(latency < stats.lat_min)
-            stats.lat_min = latency;
+static uint32_t eb_stats_find_sub(const char *name)
+{
+    uint32_t i;
+    uint32_t nb = atomic_load_explicit(&stats.nb_sub, memory_order_acquire);
 
-        if(latency > stats.lat_max)
-        {
-            stats.lat_max = latency;
-            strcpy((char *)stats.lat_max_name, name);
+    for(i = 0 ; i < nb ; i++){
+        if(strncmp(stats.subs[i], name, EB_SUB_NAME_MAX_LEN) == 0){
+            return i + 1;
         }
+    }
 
-        stats.lat_avg = (stats.lat_avg + latency)/2;
+    return 0;
+}
+
+static uint32_t eb_stats_find_evt(uint32_t event_id)
+{
+    uint32_t i;
+    uint32_t nb = atomic_load_explicit(&stats.nb_evt, memory_order_acquire);
+
+    for(i = 0 ; i < nb ; i++){
+        if(stats.evts[i] == event_id){
+            return i + 1;
+        }
     }
 
-    stats.index++;
-    if(stats.index >= EB_STAT_HIST_DEPTH)
-    {
-        stats.index = 0;
+    return 0;
+}
+
+// names are only appended, readers see them once nb_sub is published.
+// Called when subscribing, never from a callback
+uint32_t eb_stats_intern(const char *name)
+{
+    uint32_t state;
+    uint32_t nb;
+    uint32_t id = eb_stats_find_sub(name);
+
+    if(id != 0){
+        return id;
+    }
+
+    state = eb_enter_critical();
+    id = eb_stats_find_sub(name);
+    nb = atomic_load_explicit(&stats.nb_sub, memory_order_relaxed);
+    if(id == 0 && nb < EB_STATS_NB_SUBS){
+        strncpy(stats.subs[nb], name, EB_SUB_NAME_MAX_LEN - 1);
+        atomic_store_explicit(&stats.nb_sub, nb + 1, memory_order_release);
+        id = nb + 1;
+    }
+    eb_exit_critical(state);
+
+    return id != 0 ? id : EB_STATS_UNTRACKED;
+}
+
+// runs on every callback, the critical section is only entered while the
+// table has room for a new event id
+static uint32_t eb_stats_get_evt_id(uint32_t event_id)
+{
+    uint32_t state;
+    uint32_t nb;
+    uint32_t id = eb_stats_find_evt(event_id);
+
+    if(id != 0 || atomic_load_explicit(&stats.nb_evt, memory_order_relaxed) >= EB_STATS_NB_EVTS){
+        return id;
+    }
+
+    state = eb_enter_critical();
+    id = eb_stats_find_evt(event_id);
+    nb = atomic_load_explicit(&stats.nb_evt, memory_order_relaxed);
+    if(id == 0 && nb < EB_STATS_NB_EVTS){
+        stats.evts[nb] = event_id;
+        atomic_store_explicit(&stats.nb_evt, nb + 1, memory_order_release);
+        id = nb + 1;
+    }
+    eb_exit_critical(state);
+
+    return id;
+}
+
+int32_t eb_stats_add(eb_t *bus, const eb_sub_t *sub, uint32_t event_id, uint32_t latency)
+{
+    eb_stats_shard_t *shard = eb_stats_shard();
+    uint64_t max;
+    uint32_t sub_id;
+    uint32_t evt_id;
+
+    (void)bus;
+
+    eb_lat_hist_add(&shard->lat[EB_STATS_LAT_CB], latency);
+
+    // never a name lookup here, EB_STATS_UNTRACKED and 0 fall out of range
+    sub_id = sub->stats_id;
+    if(sub_id - 1 < EB_STATS_NB_SUBS){
+        eb_lat_hist_add(&shard->subs[sub_id - 1], latency);
+    }else{
+        sub_id = 0;
+    }
+
+    evt_id = eb_stats_get_evt_id(event_id);
+    if(evt_id != 0){
+        eb_lat_hist_add(&shard->evts[evt_id - 1], latency);
+    }
+
+    max = atomic_load_explicit(&shard->lat_max, memory_order_relaxed);
+    while(latency > (max >> 32) && !atomic_compare_exchange_weak_explicit(&shard->lat_max, &max,
+        ((uint64_t)latency << 32) | sub_id, memory_order_relaxed, memory_order_relaxed)){
     }
 
     return 0;
 }
 
-void eb_stats_print(void)
+void eb_stats_add_delay(uint32_t kind, uint32_t delay)
+{
+    if(kind < EB_STATS_NB_LAT){
+        eb_lat_hist_add(&eb_stats_shard()->lat[kind], delay);
+    }
+}
+
+void eb_stats_add_alloc(uint32_t kind)
+{
+    if(kind < EB_STATS_NB_ALLOC){
+        atomic_fetch_add_explicit(&eb_stats_shard()->alloc[kind], 1, memory_order_relaxed);
+    }
+}
+
+// the shard of the calling thread, see EB_STATS_NB_SHARDS
+static inline eb_counters_t *eb_stats_counters(eb_t *bus)
+{
+    return &bus->counters[eb_thread_index() % EB_STATS_NB_SHARDS];
+}
+
+void eb_stats_count(eb_t *bus, uint32_t kind, uint32_t n)
+{
+    if(kind < EB_STATS_NB_CNT){
+        atomic_fetch_add_explicit(&eb_stats_counters(bus)->cnt[kind], n, memory_order_relaxed);
+    }
+}
+
+void eb_stats_add_busy(eb_t *bus, uint64_t ns)
+{
+    atomic_fetch_add_explicit(&eb_stats_counters(bus)->busy_ns, ns, memory_order_relaxed);
+}
+
+uint32_t eb_stats_get_alloc(uint32_t kind, bool reset)
 {
     uint32_t i;
+    uint32_t nb = 0;
 
-	printf("----> event bus stats:\n");
-    printf("\t - version = %d.%d.%d\n", EVENT_BUS_MAJOR_REV, EVENT_BUS_MINOR_REV, EVENT_BUS_PATCH);
-    printf("\t - latency min = %ld ms\n", stats.lat_min);
-    printf("\t - latency max = %ld ms\n", stats.lat_max);
-	printf("\t - average latency = %ld ms\n", stats.lat_avg);
-    printf("\t - max latency subscriber = %s\n", stats.lat_max_name);
-    printf("\t - last events stats:\n");
+    if(kind >= EB_STATS_NB_ALLOC){
+        return 0;
+    }
 
-    for(i = 0 ; i < EB_STAT_HIST_DEPTH ; i++)
-    {
-        printf("\t\t > subscriber: %s - event id = 0x%.8lx - latency = %ld ms\n", stat_hist[i].name, stat_hist[i].event_id, stat_hist[i].lat);
+    for(i = 0 ; i < EB_STATS_NB_SHARDS ; i++){
+        if(reset){
+            nb += atomic_exchange_explicit(&stats.shards[i].alloc[kind], 0, memory_order_relaxed);
+        }else{
+            nb += atomic_load_explicit(&stats.shards[i].alloc[kind], memory_order_relaxed);
+        }
     }
-}
\ No newline at end of file
+
+    return nb;
+}
+
+// merges the histogram found at offset in every shard
+static void eb_stats_merge(size_t offset, eb_lat_stats_t *lat, bool reset)
+{
+    eb_lat_hist_t *hists[EB_STATS_NB_SHARDS];
+    uint32_t i;
+
+    for(i = 0 ; i < EB_STATS_NB_SHARDS ; i++){
+        hists[i] = (eb_lat_hist_t *)((uint8_t *)&stats.shards[i] + offset);
+    }
+
+    eb_lat_hist_merge(hists, EB_STATS_NB_SHARDS, lat, reset);
+}
+
+// offset of the histogram i of an array in eb_stats_shard_t
+#define EB_STATS_HIST(field, i)     (offsetof(eb_stats_shard_t, field) + (i) * sizeof(eb_lat_hist_t))
+
+int32_t eb_stats_get(uint32_t kind, eb_lat_stats_t *lat, bool reset)
+{
+    if(kind >= EB_STATS_NB_LAT){
+        return EVT_BUS_NOT_FOUND_ERR;
+    }
+
+    eb_stats_merge(EB_STATS_HIST(lat, kind), lat, reset);
+    return EVT_BUS_ERR_OK;
+}
+
+int32_t eb_stats_get_sub(const char *name, eb_lat_stats_t *lat, bool reset)
+{
+    uint32_t id = eb_stats_find_sub(name);
+
+    if(id == 0){
+        return EVT_BUS_NOT_FOUND_ERR;
+    }
+
+    eb_stats_merge(EB_STATS_HIST(subs, id - 1), lat, reset);
+    return EVT_BUS_ERR_OK;
+}
+
+int32_t eb_stats_get_evt(uint32_t event_id, eb_lat_stats_t *lat, bool reset)
+{
+    uint32_t id = eb_stats_find_evt(event_id);
+
+    if(id == 0){
+        return EVT_BUS_NOT_FOUND_ERR;
+    }
+
+    eb_stats_merge(EB_STATS_HIST(evts, id - 1), lat, reset);
+    return EVT_BUS_ERR_OK;
+}
+
+void eb_stats_walk(eb_stats_cb_t *cb, void *arg, bool reset)
+{
+    uint32_t i;
+    uint32_t nb;
+    eb_lat_stats_t lat;
+
+    nb = atomic_load_explicit(&stats.nb_sub, memory_order_acquire);
+    for(i = 0 ; i < nb ; i++){
+        eb_stats_merge(EB_STATS_HIST(subs, i), &lat, reset);
+        cb(arg, stats.subs[i], 0, &lat);
+    }
+
+    nb = atomic_load_explicit(&stats.nb_evt, memory_order_acquire);
+    for(i = 0 ; i < nb ; i++){
+        eb_stats_merge(EB_STATS_HIST(evts, i), &lat, reset);
+        cb(arg, NULL, stats.evts[i], &lat);
+    }
+}
+
+// name of the slowest subscriber call, NULL without any call or when the
+// subscriber is not tracked
+static const char *eb_stats_lat_max_name(void)
+{
+    uint64_t max = 0;
+    uint64_t lat_max;
+    uint32_t i;
+
+    for(i = 0 ; i < EB_STATS_NB_SHARDS ; i++){
+        lat_max = atomic_load_explicit(&stats.shards[i].lat_max, memory_order_relaxed);
+        max = lat_max > max ? lat_max : max;
+    }
+
+    return (max & UINT32_MAX) != 0 ? stats.subs[(max & UINT32_MAX) - 1] : NULL;
+}
+
+// histograms are emptied, subscribers and event ids stay tracked
+void eb_stats_reset(void)
+{
+    uint32_t i;
+    uint32_t j;
+    eb_lat_stats_t lat;
+
+    for(i = 0 ; i < EB_STATS_NB_LAT ; i++){
+        eb_stats_merge(EB_STATS_HIST(lat, i), &lat, true);
+    }
+    for(i = 0 ; i < EB_STATS_NB_ALLOC ; i++){
+        eb_stats_get_alloc(i, true);
+    }
+    for(i = 0 ; i < atomic_load(&stats.nb_sub) ; i++){
+        eb_stats_merge(EB_STATS_HIST(subs, i), &lat, true);
+    }
+    for(i = 0 ; i < atomic_load(&stats.nb_evt) ; i++){
+        eb_stats_merge(EB_STATS_HIST(evts, i), &lat, true);
+    }
+    for(j = 0 ; j < EB_STATS_NB_SHARDS ; j++){
+        atomic_store_explicit(&stats.shards[j].lat_max, 0, memory_order_relaxed);
+    }
+}
+
+static void eb_stats_print_lat(const char *label, const eb_lat_stats_t *lat)
+{
+    printf("\t - %s: count = %lu min = %lu mean = %lu p50 = %lu p99 = %lu p99.9 = %lu max = %lu ns\n", label,
+        (unsigned long)lat->count, (unsigned long)lat->min, (unsigned long)lat->mean, (unsigned long)lat->p50,
+        (unsigned long)lat->p99, (unsigned long)lat->p999, (unsigned long)lat->max);
+}
+
+static void eb_stats_print_cb(void *arg, const char *name, uint32_t event_id, const eb_lat_stats_t *lat)
+{
+    char label[EB_SUB_NAME_MAX_LEN + 16];
+
+    (void)arg;
+
+    if(name != NULL){
+        snprintf(label, sizeof(label), "subscriber %s", name);
+    }else{
+        snprintf(label, sizeof(label), "event 0x%.8lx", (unsigned long)event_id);
+    }
+    eb_stats_print_lat(label, lat);
+}
+
+void eb_stats_print(void)
+{
+    const char *name;
+    eb_lat_stats_t lat;
+
+	printf("----> event bus stats:\n");
+    printf("\t - version = %d.%d.%d\n", EVENT_BUS_MAJOR_REV, EVENT_BUS_MINOR_REV, EVENT_BUS_PATCH);
+    eb_stats_get(EB_STATS_LAT_QUEUE, &lat, false);
+    eb_stats_print_lat("queueing delay", &lat);
+    eb_stats_get(EB_STATS_LAT_HANDOFF, &lat, false);
+    eb_stats_print_lat("worker handoff", &lat);
+    eb_stats_get(EB_STATS_LAT_CB, &lat, false);
+    eb_stats_print_lat("subscriber latency", &lat);
+    name = eb_stats_lat_max_name();
+    printf("\t - max latency subscriber = %s\n", name != NULL ? name : "");
+    printf("\t - payloads: inline = %lu pool = %lu heap = %lu\n",
+        (unsigned long)eb_stats_get_alloc(EB_STATS_ALLOC_INLINE, false),
+        (unsigned long)eb_stats_get_alloc(EB_STATS_ALLOC_POOL, false),
+        (unsigned long)eb_stats_get_alloc(EB_STATS_ALLOC_HEAP, false));
+    eb_stats_walk(eb_stats_print_cb, NULL, false);
+}
@@ -0,0 +1,162 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "event_bus_subs.h"
+#include "event_bus_inbox.h"
+
+// copy of the nb_sub first subscribers of tbl, tbl may be NULL
+eb_sub_tbl_t *eb_sub_tbl_new(const eb_sub_tbl_t *tbl, uint32_t nb_sub)
+{
+    eb_sub_tbl_t *new_tbl;
+
+    new_tbl = eb_malloc(sizeof(eb_sub_tbl_t) + nb_sub * sizeof(eb_sub_t));
+    if(new_tbl == NULL){
+        return NULL;
+    }
+
+    memset(new_tbl, 0, sizeof(eb_sub_tbl_t) + nb_sub * sizeof(eb_sub_t));
+    atomic_init(&new_tbl->ref, 1);
+    new_tbl->nb_sub = nb_sub;
+    if(tbl != NULL){
+        memcpy(new_tbl->subs, tbl->subs, MIN(nb_sub, tbl->nb_sub) * sizeof(eb_sub_t));
+    }
+
+    return new_tbl;
+}
+
+static bool eb_sub_tbl_is_static(eb_sub_tbl_t *tbl)
+{
+    return atomic_load_explicit(&tbl->ref, memory_order_relaxed) == EB_SUB_TBL_STATIC;
+}
+
+void eb_sub_tbl_ref(eb_sub_tbl_t *tbl)
+{
+    if(tbl == NULL || eb_sub_tbl_is_static(tbl)){
+        return;
+    }
+
+    atomic_fetch_add_explicit(&tbl->ref, 1, memory_order_relaxed);
+}
+
+void eb_sub_tbl_release(eb_sub_tbl_t *tbl)
+{
+    if(tbl == NULL || eb_sub_tbl_is_static(tbl)){
+        return;
+    }
+
+    if(atomic_fetch_sub_explicit(&tbl->ref, 1, memory_order_acq_rel) == 1){
+        eb_free(tbl);
+    }
+}
+
+static void eb_sub_tbl_push(eb_t *bus, eb_sub_tbl_t *tbl)
+{
+    eb_sub_tbl_t *head;
+
+    head = atomic_load_explicit(&bus->retired, memory_order_relaxed);
+    do{
+        tbl->next = head;
+    }while(!atomic_compare_exchange_weak_explicit(&bus->retired, &head, tbl,
+        memory_order_release, memory_order_relaxed));
+}
+
+// called by writers once tbl has been replaced
+void eb_sub_tbl_retire(eb_t *bus, eb_sub_tbl_t *tbl)
+{
+    // a static table is in read-only memory and outlives the bus
+    if(tbl == NULL || eb_sub_tbl_is_static(tbl)){
+        return;
+    }
+
+    tbl->epoch = eb_epoch_retire(bus);
+    eb_sub_tbl_push(bus, tbl);
+
+    // an idle dispatcher does not wake up on its own
+    eb_inbox_kick(&bus->shards[0].inbox);
+}
+
+// called by the dispatchers between two batches, tables retired so far
+// can't be reached from eb_evt_t anymore
+void eb_sub_tbl_reclaim(eb_t *bus)
+{
+    eb_sub_tbl_t *tbl;
+    eb_sub_tbl_t *next;
+
+    if(atomic_load_explicit(&bus->retired, memory_order_relaxed) == NULL){
+        return;
+    }
+
+    tbl = atomic_exchange_explicit(&bus->retired, NULL, memory_order_acquire);
+    while(tbl != NULL){
+        next = tbl->next;
+        if(eb_epoch_passed(bus, tbl->epoch)){
+            eb_sub_tbl_release(tbl);
+        }else{
+            // another dispatcher frees it at the end of its batch
+            eb_sub_tbl_push(bus, tbl);
+        }
+        tbl = next;
+    }
+}
+
+void eb_epoch_enter(eb_shard_t *shard)
+{
+    atomic_store(&shard->epoch, atomic_load(&shard->bus->epoch));
+    // pairs with the fence of eb_epoch_passed, either the epoch is seen or
+    // the table swapped out before it is not loaded
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void eb_epoch_exit(eb_shard_t *shard)
+{
+    atomic_store_explicit(&shard->epoch, 0, memory_order_release);
+}
+
+// epochs are odd, 0 tells a dispatcher between batches
+uint32_t eb_epoch_retire(eb_t *bus)
+{
+    return atomic_fetch_add(&bus->epoch, 2);
+}
+
+bool eb_epoch_passed(eb_t *bus, uint32_t epoch)
+{
+    uint32_t seen;
+    uint32_t i;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    for(i = 0 ; i < bus->nb_shards ; i++){
+        seen = atomic_load_explicit(&bus->shards[i].epoch, memory_order_acquire);
+        if(seen != 0 && (int32_t)(seen - epoch) <= 0){
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -31,24 +31,183 @@
 #include "event_bus_supv.h"
 #include "event_bus_worker.h"
 
+typedef struct eb_supv_t
+{
+    eb_worker_t *heap[MAX_NB_WORKERS];          // running subscribers, earliest deadline first
+    uint32_t nb;
+    bool armed;                                 // the thread sleeps until wake_at
+    uint32_t wake_at;
+    eb_sem_t wake;
+    eb_thread_t thread;
+}eb_supv_t;
+
+static eb_supv_t supv;
+
+// tick values wrap, compare them through their difference
+static inline bool eb_supv_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static void eb_supv_set(uint32_t pos, eb_worker_t *worker)
+{
+    supv.heap[pos] = worker;
+    worker->heap_pos = (int32_t)pos;
+}
 
-void eb_supv_start(eb_worker_t *worker)
+static void eb_supv_up(uint32_t pos)
 {
-    worker->timer_enabled = true;
-    worker->start_time = eb_get_tick();
-    return 0;
+    eb_worker_t *worker = supv.heap[pos];
+    uint32_t parent;
+
+    while(pos > 0){
+        parent = (pos - 1) / 2;
+        if(!eb_supv_before(worker->deadline, supv.heap[parent]->deadline)){
+            break;
+        }
+        eb_supv_set(pos, supv.heap[parent]);
+        pos = parent;
+    }
+    eb_supv_set(pos, worker);
 }
 
-void eb_supv_run(void)
+static void eb_supv_down(uint32_t pos)
 {
-    uint32_t t = eb_get_tick();
-    eb_worker_t *workers = eb_worker_get_list();
-    uint32_t i = 0;
+    eb_worker_t *worker = supv.heap[pos];
+    uint32_t child;
+
+    while((child = 2 * pos + 1) < supv.nb){
+        if(child + 1 < supv.nb && eb_supv_before(supv.heap[child + 1]->deadline, supv.heap[child]->deadline)){
+            child++;
+        }
+        if(!eb_supv_before(supv.heap[child]->deadline, worker->deadline)){
+            break;
+        }
+        eb_supv_set(pos, supv.heap[child]);
+        pos = child;
+    }
+    eb_supv_set(pos, worker);
+}
+
+// called inside a critical section
+static void eb_supv_remove(eb_worker_t *worker)
+{
+    uint32_t pos = (uint32_t)worker->heap_pos;
+    eb_worker_t *last;
+
+    worker->heap_pos = -1;
+    supv.nb--;
+    if(pos == supv.nb){
+        return;
+    }
+
+    // move the last entry in the hole
+    last = supv.heap[supv.nb];
+    eb_supv_set(pos, last);
+    eb_supv_up(pos);
+    eb_supv_down((uint32_t)last->heap_pos);
+}
+
+static void eb_supv_thread(void *arg)
+{
+    eb_worker_t *expired;
+    eb_work_t work;
+    uint32_t timeout;
+    uint32_t state;
+    int32_t left;
+
+    (void)arg;
+
+    while(1){
+        expired = NULL;
+        timeout = EB_WAIT_FOREVER;
+
+        state = eb_enter_critical();
+        supv.armed = supv.nb > 0;
+        if(supv.nb > 0){
+            left = (int32_t)(supv.heap[0]->deadline - eb_get_tick());
+            if(left <= 0){
+                // snapshot the message before eb_supv_stop lets the
+                // worker release it
+                expired = supv.heap[0];
+                eb_supv_remove(expired);
+                eb_worker_cancel(expired, &work);
+            }else{
+                supv.wake_at = supv.heap[0]->deadline;
+                timeout = EB_TICK_TO_MS(left);
+            }
+        }
+        eb_exit_critical(state);
 
-    for(i = 0 ; i < MAX_NB_WORKERS ; i++){
-        if(workers[i].running && (t - workers[i].start_time >= EVT_MAX_SUB_LATENCY_MS) && workers[i].timer_enabled){
-            workers[i].timer_enabled = false;
-            eb_worker_timeout(&workers[i]);
+        if(expired != NULL){
+            eb_worker_timeout(expired, &work);
+            continue;
         }
+
+        // nothing to supervise, sleep until a subscriber starts
+        eb_sem_take(&supv.wake, timeout);
+    }
+}
+
+int32_t eb_supv_init(void)
+{
+    supv.nb = 0;
+    supv.armed = false;
+
+    if(eb_sem_new(&supv.wake)){
+        return EVT_WORKER_ERR;
     }
-}
\ No newline at end of file
+
+    supv.thread = eb_thread_new("eb_supv", eb_supv_thread, NULL, EB_STACK_SIZE, EB_PRIO);
+    if(supv.thread == NULL){
+        return EVT_WORKER_ERR;
+    }
+
+    return EVT_BUS_ERR_OK;
+}
+
+void eb_supv_start(eb_worker_t *worker, uint32_t deadline_ms)
+{
+    uint32_t state;
+    bool wake;
+
+    if(deadline_ms == 0){
+        deadline_ms = EB_MAX_SUB_LATENCY_MS;
+    }
+
+    state = eb_enter_critical();
+    worker->deadline = eb_get_tick() + EB_MS_TO_TICK(deadline_ms);
+    if(worker->heap_pos < 0){
+        supv.heap[supv.nb] = worker;
+        worker->heap_pos = (int32_t)supv.nb;
+        supv.nb++;
+        eb_supv_up((uint32_t)worker->heap_pos);
+    }else{
+        // next subscriber of the same event
+        eb_supv_up((uint32_t)worker->heap_pos);
+        eb_supv_down((uint32_t)worker->heap_pos);
+    }
+
+    // the thread only needs a wakeup when it sleeps past the new deadline
+    wake = supv.heap[0] == worker && (!supv.armed || eb_supv_before(worker->deadline, supv.wake_at));
+    if(wake){
+        supv.armed = true;
+        supv.wake_at = worker->deadline;
+    }
+    eb_exit_critical(state);
+
+    if(wake){
+        eb_sem_give(&supv.wake);
+    }
+}
+
+void eb_supv_stop(eb_worker_t *worker)
+{
+    uint32_t state;
+
+    state = eb_enter_critical();
+    if(worker->heap_pos >= 0){
+        eb_supv_remove(worker);
+    }
+    eb_exit_critical(state);
+}
@@ -0,0 +1,333 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include "event_bus_timer.h"
+#include "event_bus_buf.h"
+
+#if EB_MAX_TIMERS > 0
+
+#if EB_MAX_TIMERS > 0xFFFE
+#error "EB_MAX_TIMERS doesn't fit in a timer id"
+#endif
+
+#define EB_TIMER_MASK               (EB_TIMER_SLOTS - 1)
+#define EB_TIMER_SPAN               (1U << (EB_TIMER_LEVELS * EB_TIMER_WHEEL_BITS))
+#define EB_TIMER_UNLINKED           (0xFF)      // level of a free timer
+
+// wheel ticks wrap, compare them through their difference
+static inline bool eb_timer_before(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) < 0;
+}
+
+static uint64_t eb_timer_ms(void)
+{
+    return eb_get_time_ns() / 1000000ULL;
+}
+
+static eb_timer_id_t eb_timer_id(eb_timers_t *timers, eb_timer_t *timer)
+{
+    return ((uint32_t)timer->gen << 16) | (uint32_t)(timer - timers->pool + 1);
+}
+
+static void eb_timer_link(eb_timers_t *timers, eb_timer_t *timer)
+{
+    uint32_t expire = timer->expire;
+    uint32_t delta = expire - timers->now;
+    uint32_t level;
+    eb_timer_t **head;
+
+    if((int32_t)delta < 0){
+        // already due, fired with the next tick
+        expire = timers->now;
+        delta = 0;
+    }else if(delta >= EB_TIMER_SPAN){
+        // linked again each time the last wheel brings it down
+        expire = timers->now + EB_TIMER_SPAN - 1;
+        delta = EB_TIMER_SPAN - 1;
+    }
+
+    for(level = 0 ; level < EB_TIMER_LEVELS - 1 ; level++){
+        if(delta < (1U << ((level + 1) * EB_TIMER_WHEEL_BITS))){
+            break;
+        }
+    }
+
+    timer->level = (uint8_t)level;
+    timer->slot = (uint8_t)((expire >> (level * EB_TIMER_WHEEL_BITS)) & EB_TIMER_MASK);
+
+    head = &timers->slots[level][timer->slot];
+    timer->prev = NULL;
+    timer->next = *head;
+    if(*head != NULL){
+        (*head)->prev = timer;
+    }
+    *head = timer;
+    timers->busy[level] |= 1ULL << timer->slot;
+}
+
+static void eb_timer_unlink(eb_timers_t *timers, eb_timer_t *timer)
+{
+    if(timer->prev != NULL){
+        timer->prev->next = timer->next;
+    }else{
+        timers->slots[timer->level][timer->slot] = timer->next;
+    }
+
+    if(timer->next != NULL){
+        timer->next->prev = timer->prev;
+    }
+
+    if(timers->slots[timer->level][timer->slot] == NULL){
+        timers->busy[timer->level] &= ~(1ULL << timer->slot);
+    }
+}
+
+// the whole slot, it is left empty
+static eb_timer_t *eb_timer_take(eb_timers_t *timers, uint32_t level, uint32_t slot)
+{
+    eb_timer_t *timer = timers->slots[level][slot];
+
+    timers->slots[level][slot] = NULL;
+    timers->busy[level] &= ~(1ULL << slot);
+
+    return timer;
+}
+
+static void eb_timer_free(eb_timers_t *timers, eb_timer_t *timer)
+{
+    eb_buf_release(timer->data);
+    timer->data = NULL;
+    timer->level = EB_TIMER_UNLINKED;
+    timer->gen++;
+    timer->next = timers->free;
+    timers->free = timer;
+
+    // an empty wheel is not run, the next timer added wakes the dispatcher
+    if(atomic_fetch_sub_explicit(&timers->nb, 1, memory_order_relaxed) == 1){
+        timers->armed = false;
+    }
+}
+
+static void eb_timer_tick(eb_timers_t *timers, eb_timer_fire_cb_t *fire, void *ctx)
+{
+    uint32_t index = timers->now & EB_TIMER_MASK;
+    uint32_t level;
+    eb_timer_t *timer;
+    eb_timer_t *next;
+
+    // the lower wheel wrapped around, the next slot of the upper one comes down
+    for(level = 1 ; index == 0 && level < EB_TIMER_LEVELS ; level++){
+        index = (timers->now >> (level * EB_TIMER_WHEEL_BITS)) & EB_TIMER_MASK;
+        for(timer = eb_timer_take(timers, level, index) ; timer != NULL ; timer = next){
+            next = timer->next;
+            eb_timer_link(timers, timer);
+        }
+    }
+
+    timer = eb_timer_take(timers, 0, timers->now & EB_TIMER_MASK);
+    for( ; timer != NULL ; timer = next){
+        next = timer->next;
+        fire(ctx, timer);
+
+        if(timer->period > 0){
+            // missed periods are skipped rather than fired in a burst
+            do{
+                timer->expire += timer->period;
+            }while(!eb_timer_before(timers->now, timer->expire));
+            eb_timer_link(timers, timer);
+        }else{
+            eb_timer_free(timers, timer);
+        }
+    }
+
+    timers->now++;
+}
+
+// next tick with a timer in the lower wheel, or the tick it wraps around at
+static uint32_t eb_timer_next(eb_timers_t *timers)
+{
+    uint32_t index = timers->now & EB_TIMER_MASK;
+    uint64_t pending = timers->busy[0] >> index;
+
+    // the upper wheels cascade at the start of a wrapping tick
+    if(index == 0){
+        return timers->now;
+    }
+
+    if(pending != 0){
+        return timers->now + (uint32_t)__builtin_ctzll(pending);
+    }
+
+    return timers->now + EB_TIMER_SLOTS - index;
+}
+
+int32_t eb_timer_init(eb_timers_t *timers)
+{
+    uint32_t i;
+    eb_timer_t *timer;
+
+    memset(timers, 0, sizeof(eb_timers_t));
+    atomic_init(&timers->nb, 0);
+
+    if(eb_mutex_new(&timers->lock)){
+        return EVT_BUS_MUTEX_ERR;
+    }
+
+    for(i = EB_MAX_TIMERS ; i > 0 ; i--){
+        timer = &timers->pool[i - 1];
+        timer->level = EB_TIMER_UNLINKED;
+        timer->next = timers->free;
+        timers->free = timer;
+    }
+
+    return EVT_BUS_ERR_OK;
+}
+
+int32_t eb_timer_add(eb_timers_t *timers, uint32_t evt_id, void *data, uint32_t len, uint32_t prio,
+    uint32_t delay_ms, uint32_t period_ms, eb_timer_id_t *id, bool *kick)
+{
+    eb_timer_t *timer;
+    uint64_t ms;
+    uint64_t tick;
+    uint64_t delay;
+
+    *kick = false;
+
+    if(eb_mutex_take(&timers->lock, EB_WAIT_FOREVER)){
+        eb_buf_release(data);
+        return EVT_BUS_LOCK_ERR;
+    }
+
+    timer = timers->free;
+    if(timer == NULL){
+        eb_mutex_give(&timers->lock);
+        eb_buf_release(data);
+        return EVT_BUS_TIMER_ERR;
+    }
+    timers->free = timer->next;
+
+    // the wheel is not run while empty, catch up with the clock
+    ms = eb_timer_ms();
+    if(atomic_load_explicit(&timers->nb, memory_order_relaxed) == 0){
+        timers->now = (uint32_t)(ms / EB_TIMER_TICK_MS);
+    }
+
+    // the first tick starting after the delay, ticks are compared through
+    // their signed difference
+    tick = ms / EB_TIMER_TICK_MS;
+    delay = (ms + delay_ms + EB_TIMER_TICK_MS - 1) / EB_TIMER_TICK_MS - tick;
+    timer->expire = (uint32_t)tick + (uint32_t)MIN(delay, (uint64_t)(INT32_MAX / 2));
+    timer->period = (period_ms + EB_TIMER_TICK_MS - 1) / EB_TIMER_TICK_MS;
+    if(period_ms > 0 && timer->period == 0){
+        timer->period = 1;
+    }
+    timer->evt_id = evt_id;
+    timer->prio = prio;
+    timer->len = len;
+    timer->data = data;
+    eb_timer_link(timers, timer);
+    atomic_fetch_add_explicit(&timers->nb, 1, memory_order_release);
+
+    // the dispatcher only needs a wakeup when it sleeps past the new timer
+    if(!timers->armed || eb_timer_before(timer->expire, timers->wake_at)){
+        timers->armed = true;
+        timers->wake_at = timer->expire;
+        *kick = true;
+    }
+
+    if(id != NULL){
+        *id = eb_timer_id(timers, timer);
+    }
+
+    eb_mutex_give(&timers->lock);
+    return EVT_BUS_ERR_OK;
+}
+
+int32_t eb_timer_del(eb_timers_t *timers, eb_timer_id_t id)
+{
+    uint32_t index = (id & 0xFFFF) - 1;
+    int32_t rc = EVT_BUS_NOT_FOUND_ERR;
+    eb_timer_t *timer;
+
+    if(index >= EB_MAX_TIMERS){
+        return EVT_BUS_NOT_FOUND_ERR;
+    }
+
+    if(eb_mutex_take(&timers->lock, EB_WAIT_FOREVER)){
+        return EVT_BUS_LOCK_ERR;
+    }
+
+    // a fired one shot timer or a reused slot has another generation
+    timer = &timers->pool[index];
+    if(timer->level != EB_TIMER_UNLINKED && timer->gen == (id >> 16)){
+        eb_timer_unlink(timers, timer);
+        eb_timer_free(timers, timer);
+        rc = EVT_BUS_ERR_OK;
+    }
+
+    eb_mutex_give(&timers->lock);
+    return rc;
+}
+
+uint32_t eb_timer_run(eb_timers_t *timers, eb_timer_fire_cb_t *fire, void *ctx)
+{
+    uint64_t ms;
+    uint32_t tick;
+    uint32_t next;
+    uint32_t timeout = EB_WAIT_FOREVER;
+
+    if(atomic_load_explicit(&timers->nb, memory_order_acquire) == 0){
+        return EB_WAIT_FOREVER;
+    }
+
+    if(eb_mutex_take(&timers->lock, EB_WAIT_FOREVER)){
+        return EB_TIMER_TICK_MS;
+    }
+
+    ms = eb_timer_ms();
+    tick = (uint32_t)(ms / EB_TIMER_TICK_MS);
+    while(atomic_load_explicit(&timers->nb, memory_order_relaxed) > 0 && !eb_timer_before(tick, timers->now)){
+        eb_timer_tick(timers, fire, ctx);
+    }
+
+    timers->armed = false;
+    if(atomic_load_explicit(&timers->nb, memory_order_relaxed) > 0){
+        next = eb_timer_next(timers);
+        timers->armed = true;
+        timers->wake_at = next;
+        timeout = (next - tick) * EB_TIMER_TICK_MS - (uint32_t)(ms % EB_TIMER_TICK_MS);
+    }
+
+    eb_mutex_give(&timers->lock);
+    return timeout;
+}
+
+#endif
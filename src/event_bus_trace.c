@@ -0,0 +1,154 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019 Jocelyn Masserot
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal with the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *  1. The above copyright notice and this permission notice shall be included in all
+ *     copies or substantial portions of the Software.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimers in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+ *     may be used to endorse or promote products derived from this Software
+ *     without specific prior written permission.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * WITH THE SOFTWARE.
+ */
+
+#include <string.h>
+#include "event_bus_trace.h"
+
+#if EB_USE_TRACE
+
+#if (EB_TRACE_DEPTH & (EB_TRACE_DEPTH - 1)) != 0
+#error "EB_TRACE_DEPTH must be a power of 2"
+#endif
+
+typedef struct eb_trace_slot_t
+{
+    atomic_uint seq;                            // ring position + 1 once written, 0 while written
+    eb_trace_rec_t rec;
+}eb_trace_slot_t;
+
+typedef struct eb_trace_ring_t
+{
+    _Alignas(EB_CACHE_LINE) atomic_uint head;   // next position
+    eb_trace_slot_t slots[EB_TRACE_DEPTH];
+}eb_trace_ring_t;
+
+static eb_trace_ring_t rings[EB_TRACE_NB_RINGS];
+static atomic_bool enabled = true;
+
+void eb_trace_rec(uint8_t stage, uint32_t evt_id, uint32_t key, uint32_t len, uint32_t arg, const char *name)
+{
+    uint32_t thread;
+    uint32_t pos;
+    eb_trace_ring_t *ring;
+    eb_trace_slot_t *slot;
+
+    if(!atomic_load_explicit(&enabled, memory_order_relaxed)){
+        return;
+    }
+
+    thread = eb_thread_index();
+    ring = &rings[thread % EB_TRACE_NB_RINGS];
+    pos = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    slot = &ring->slots[pos & (EB_TRACE_DEPTH - 1)];
+
+    // a reader seeing the old stamp after copying the record drops it
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->rec.ts = eb_get_time_ns();
+    slot->rec.evt_id = evt_id;
+    slot->rec.key = key;
+    slot->rec.len = len;
+    slot->rec.thread = (uint16_t)thread;
+    slot->rec.stage = stage;
+    slot->rec.arg = (uint8_t)arg;
+    if(name != NULL){
+        strncpy(slot->rec.name, name, sizeof(slot->rec.name));
+    }else{
+        slot->rec.name[0] = '\0';
+    }
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+void eb_trace_enable(bool enable)
+{
+    atomic_store_explicit(&enabled, enable, memory_order_relaxed);
+}
+
+// records being written meanwhile may survive the reset
+void eb_trace_reset(void)
+{
+    uint32_t i;
+    uint32_t j;
+
+    for(i = 0 ; i < EB_TRACE_NB_RINGS ; i++){
+        for(j = 0 ; j < EB_TRACE_DEPTH ; j++){
+            atomic_store_explicit(&rings[i].slots[j].seq, 0, memory_order_relaxed);
+        }
+    }
+}
+
+int32_t eb_trace_dump(eb_trace_write_cb_t *write, void *ctx)
+{
+    eb_trace_hdr_t hdr;
+    eb_trace_rec_t rec;
+    eb_trace_slot_t *slot;
+    uint32_t head;
+    uint32_t pos;
+    uint32_t i;
+    int32_t nb = 0;
+
+    hdr.magic = EB_TRACE_MAGIC;
+    hdr.version = EB_TRACE_VERSION;
+    hdr.rec_size = sizeof(eb_trace_rec_t);
+    if(write(ctx, &hdr, sizeof(hdr))){
+        return EVT_BUS_TRACE_ERR;
+    }
+
+    for(i = 0 ; i < EB_TRACE_NB_RINGS ; i++){
+        head = atomic_load_explicit(&rings[i].head, memory_order_acquire);
+        pos = head > EB_TRACE_DEPTH ? head - EB_TRACE_DEPTH : 0;
+
+        for( ; pos != head ; pos++){
+            slot = &rings[i].slots[pos & (EB_TRACE_DEPTH - 1)];
+            if(atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1){
+                continue;
+            }
+
+            memcpy(&rec, &slot->rec, sizeof(rec));
+
+            // overwritten while copied
+            atomic_thread_fence(memory_order_acquire);
+            if(atomic_load_explicit(&slot->seq, memory_order_relaxed) != pos + 1){
+                continue;
+            }
+
+            if(write(ctx, &rec, sizeof(rec))){
+                return EVT_BUS_TRACE_ERR;
+            }
+            nb++;
+        }
+    }
+
+    return nb;
+}
+
+#endif
@@ -32,128 +32,329 @@
 #include "event_bus_worker.h"
 #include "event_bus_supv.h"
 #include "event_bus_stats.h"
+#include "event_bus_buf.h"
+#include "event_bus_subs.h"
+#include "event_bus_trace.h"
 
 static eb_worker_t workers[MAX_NB_WORKERS];
+static uint32_t nb_workers = 0;
+static eb_sem_t space;                          // given when a full pool takes an event
+static atomic_uint waiters;
 
-void eb_worker_timeout(eb_worker_t *worker)
+// exact subscribers first, then mask and range subscribers
+static uint32_t eb_worker_nb_sub(const eb_msg_t *msg)
+{
+    return (msg->subs != NULL ? msg->subs->nb_sub : 0) + (msg->psubs != NULL ? msg->psubs->nb_sub : 0);
+}
+
+static eb_sub_t *eb_worker_get_sub(const eb_msg_t *msg, uint32_t index)
+{
+    uint32_t nb_sub = msg->subs != NULL ? msg->subs->nb_sub : 0;
+
+    if(index < nb_sub){
+        return &msg->subs->subs[index];
+    }
+
+    return &msg->psubs->subs[index - nb_sub];
+}
+
+// called by the supervisor in the critical section taking the worker off the
+// deadline heap: the worker is still in its subscriber, it can't release the
+// message nor start the next one until it has left eb_supv_stop
+void eb_worker_cancel(eb_worker_t *worker, eb_work_t *work)
 {
     worker->cancelled = true;
-    if(worker->msg.evt->nb_sub > worker->index){
-        eb_log_warn("worker timeout, defer event id %x to a new worker\n");
-        eb_worker_post(worker->bus, worker->msg.evt, worker->index, worker->msg.data, worker->msg.len);
+    work->bus = worker->bus;
+    work->index = worker->index;
+    memcpy(&work->msg, &worker->msg, sizeof(eb_msg_t));
+    eb_msg_ref(&work->msg);
+    eb_sub_tbl_ref(work->msg.subs);
+    eb_sub_tbl_ref(work->msg.psubs);
+}
+
+// outside the critical section, drops the references of eb_worker_cancel
+void eb_worker_timeout(eb_worker_t *worker, eb_work_t *work)
+{
+    eb_msg_t *msg = &work->msg;
+
+    (void)worker;
+
+    eb_trace(EB_TRACE_TIMEOUT, msg->evt_id, msg->pub_ns, msg->len, worker->id, NULL);
+    if(eb_worker_nb_sub(msg) > work->index){
+        eb_log_warn("worker timeout, defer event id %x to a new worker\n", msg->evt_id);
+        eb_trace(EB_TRACE_DEFER, msg->evt_id, msg->pub_ns, msg->len, work->index, NULL);
+        eb_stats_count(work->bus, EB_STATS_CNT_DEFERRED, 1);
+        // the supervisor never waits, it has other deadlines to keep
+        eb_worker_post(work->bus, msg, work->index, 0);
+    }
+
+    eb_msg_release(msg);
+    eb_sub_tbl_release(msg->subs);
+    eb_sub_tbl_release(msg->psubs);
+}
+
+static bool eb_worker_pop(eb_worker_t *worker, eb_work_t *work)
+{
+    uint32_t count;
+    bool found = false;
+
+    if(eb_mutex_take(&worker->lock, EB_WORKER_QUEUE_PERIOD)){
+        return false;
+    }
+
+    count = atomic_load_explicit(&worker->count, memory_order_relaxed);
+    if(count > 0){
+        memcpy(work, &worker->mailbox[worker->head], sizeof(eb_work_t));
+        worker->head = (worker->head + 1) % EB_WORKER_QUEUE_LEN;
+        atomic_store_explicit(&worker->count, count - 1, memory_order_relaxed);
+        found = true;
     }
+
+    eb_mutex_give(&worker->lock);
+
+    // a poster announces itself in waiters before a last try under the lock,
+    // it either finds the slot freed or is woken up
+    if(found && atomic_load(&waiters)){
+        eb_sem_give(&space);
+    }
+    return found;
 }
 
-static void eb_worker_thread(void *arg)
+static bool eb_worker_push(eb_worker_t *worker, const eb_work_t *work)
 {
-    eb_worker_t *worker = (eb_worker_t *)arg;
-    eb_t *bus = worker->bus;
-    eb_msg_t msg;
+    uint32_t count;
+    bool pushed = false;
+
+    if(eb_mutex_take(&worker->lock, EB_WORKER_QUEUE_PERIOD)){
+        return false;
+    }
+
+    count = atomic_load_explicit(&worker->count, memory_order_relaxed);
+    if(count < EB_WORKER_QUEUE_LEN){
+        memcpy(&worker->mailbox[(worker->head + count) % EB_WORKER_QUEUE_LEN], work, sizeof(eb_work_t));
+        atomic_store_explicit(&worker->count, count + 1, memory_order_relaxed);
+        pushed = true;
+    }
+
+    eb_mutex_give(&worker->lock);
+    return pushed;
+}
+
+// take the oldest event waiting behind a busy worker
+static bool eb_worker_steal(eb_worker_t *worker, eb_work_t *work)
+{
+    uint32_t i;
+    eb_worker_t *victim;
+
+    for(i = 1 ; i < nb_workers ; i++){
+        victim = &workers[(worker->id + i) % nb_workers];
+        if(atomic_load_explicit(&victim->count, memory_order_relaxed) > 0 && eb_worker_pop(victim, work)){
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void eb_worker_run(eb_worker_t *worker, eb_work_t *work)
+{
+    eb_t *bus = work->bus;
+    eb_msg_t *msg = &work->msg;
     eb_sub_t *sub;
-    uint32_t i = 0;
+    uint64_t start;
+    uint32_t i;
 
-    while(1){
-        if(eb_queue_get(&worker->queue, &msg, EB_WORKER_QUEUE_PERIOD) == 0){
-            worker->running = true;
-            worker->cancelled = false;
-            worker->msg.evt = msg.evt;
-            worker->msg.data = NULL;
-            worker->msg.len = msg.len;
-
-            if(msg.len){
-                worker->msg.data = msg.data;
-            }
+    // dispatch to worker start, includes the time spent in a mailbox
+    start = eb_get_time_ns();
+    eb_stats_add_delay(EB_STATS_LAT_HANDOFF, (uint32_t)start - work->post_ns);
 
-            // Call all sub first
-            if(!bus->all_sub.direct && worker->index == 0){
-                eb_worker_exec(bus, &bus->all_sub, msg.evt->id, msg.data, msg.len);
-            }
+    worker->bus = bus;
+    worker->index = work->index;
+    worker->cancelled = false;
+    memcpy(&worker->msg, msg, sizeof(eb_msg_t));
+    worker->running = true;
 
-            for(i = worker->index ; i < msg.evt->nb_sub ; i++){
-                sub = &msg.evt->subs[i];
-                if(!sub->direct){
-                    eb_supv_start(worker);
-                    worker->index++;
-                    eb_worker_exec(worker->bus, sub, msg.evt->id, msg.data, msg.len);
-                    if(worker->cancelled){
-                        // worker has been cancelled, exit running state
-                        break;
-                    }
-                }
-            }
+    // Call all sub first
+    if(bus->all_sub.cb != NULL && !bus->all_sub.direct && worker->index == 0){
+        eb_worker_exec(bus, &bus->all_sub, msg);
+    }
 
-            // don't free data just yet in the case worker has been cancelled
-            if(worker->msg.data && !worker->cancelled){
-                eb_free(worker->msg.data);
+    for(i = worker->index ; i < eb_worker_nb_sub(msg) ; i++){
+        sub = eb_worker_get_sub(msg, i);
+        if(!sub->direct){
+            // set before the supervisor can see the worker
+            worker->index = i + 1;
+            eb_supv_start(worker, sub->deadline_ms);
+            eb_worker_exec(bus, sub, msg);
+            eb_supv_stop(worker);
+            if(worker->cancelled){
+                // worker has been cancelled, exit running state
+                break;
             }
-            worker->running = false;
         }
     }
+
+    worker->running = false;
+    eb_stats_add_busy(bus, eb_get_time_ns() - start);
+
+    // a deferred worker holds its own references
+    eb_msg_release(msg);
+    eb_sub_tbl_release(msg->subs);
+    eb_sub_tbl_release(msg->psubs);
 }
 
-static eb_worker_t *eb_worker_get(uint32_t *id)
+static void eb_worker_thread(void *arg)
 {
-    for(*id = 0 ; *id < MAX_NB_WORKERS ; (*id)++){
-        if(!workers[*id].running){
-            return &workers[*id];
+    eb_worker_t *worker = (eb_worker_t *)arg;
+    eb_work_t work;
+
+    while(1){
+        if(eb_worker_pop(worker, &work) || eb_worker_steal(worker, &work)){
+            eb_worker_run(worker, &work);
+            continue;
         }
-    }
 
-    return NULL;
+        // announce we are idle before a last look, a poster that missed the
+        // flag has queued its event where we can steal it
+        atomic_store(&worker->idle, 1);
+        if(eb_worker_pop(worker, &work) || eb_worker_steal(worker, &work)){
+            atomic_store(&worker->idle, 0);
+            eb_worker_run(worker, &work);
+            continue;
+        }
+
+        eb_sem_take(&worker->wake, EB_WAIT_FOREVER);
+        atomic_store(&worker->idle, 0);
+    }
 }
 
-int32_t eb_worker_exec(eb_t *bus, eb_sub_t *sub, uint32_t event_id, void *data, uint32_t len)
+int32_t eb_worker_exec(eb_t *bus, eb_sub_t *sub, eb_msg_t *msg)
 {
-    uint32_t latency = 0;
+    uint64_t latency;
 
-    latency = eb_get_tick();
+    eb_trace(EB_TRACE_CB_START, msg->evt_id, msg->pub_ns, msg->len, 0, sub->name);
+    latency = eb_get_time_ns();
     if(sub->cb){
-        sub->cb(bus->app_ctx, event_id, data, len, sub->arg);
+        sub->cb(bus->app_ctx, msg->evt_id, eb_msg_data(msg), msg->len, sub->arg);
     }
-    latency = eb_get_tick() - latency;
-    eb_stats_add(bus, sub->name, event_id, latency);
+    latency = eb_get_time_ns() - latency;
+    eb_trace(EB_TRACE_CB_END, msg->evt_id, msg->pub_ns, msg->len, 0, sub->name);
+    eb_stats_add(bus, sub, msg->evt_id, (uint32_t)MIN(latency, UINT32_MAX));
 
     return 0;
 }
 
-int32_t eb_worker_post(eb_t *bus, eb_evt_t *evt, uint8_t index, void *data, uint32_t len)
+static eb_worker_t *eb_worker_get_idle(void)
 {
-    uint32_t id = 0;
+    uint32_t i;
+
+    for(i = 0 ; i < nb_workers ; i++){
+        if(atomic_load(&workers[i].idle)){
+            return &workers[i];
+        }
+    }
+
+    return NULL;
+}
+
+// an idle worker first, then the least loaded mailbox
+static eb_worker_t *eb_worker_place(const eb_work_t *work)
+{
+    uint32_t i;
+    uint32_t count;
+    uint32_t min = EB_WORKER_QUEUE_LEN;
     eb_worker_t *worker;
-    eb_msg_t msg;
-    int32_t rc = EVT_WORKER_ERR;
 
-    worker = eb_worker_get(&id);
-    if(worker == NULL){
-        eb_log_err("no workers available, drop event id 0x%lx\n", evt->id);
-        goto exit;
+    worker = eb_worker_get_idle();
+    if(worker != NULL && eb_worker_push(worker, work)){
+        return worker;
     }
 
-    worker->bus = bus;
-    worker->index = index;
-    sprintf(worker->name, "wkr_%ld_th", id);
+    worker = NULL;
+    for(i = 0 ; i < nb_workers ; i++){
+        count = atomic_load_explicit(&workers[i].count, memory_order_relaxed);
+        if(count < min){
+            worker = &workers[i];
+            min = count;
+        }
+    }
+
+    if(worker != NULL && eb_worker_push(worker, work)){
+        return worker;
+    }
+
+    return NULL;
+}
+
+// with every mailbox full the poster waits up to timeout ms for a worker to
+// take an event, the same handshake as a publisher blocked on a full inbox
+int32_t eb_worker_post(eb_t *bus, eb_msg_t *msg, uint8_t index, uint32_t timeout)
+{
+    eb_work_t work;
+    eb_worker_t *worker;
+    eb_worker_t *idle;
+    uint32_t start = 0;
+    uint32_t ticks = 0;
+    uint32_t elapsed;
+    bool waiting = false;
 
-    if(worker->thread == NULL){
-        if(eb_queue_new(&worker->queue, sizeof(eb_msg_t), 1)){
-            eb_log_err("%s queue failed\n", worker->name);
-            goto exit;
+    work.bus = bus;
+    work.index = index;
+    work.post_ns = (uint32_t)eb_get_time_ns();
+    memcpy(&work.msg, msg, sizeof(eb_msg_t));
+    eb_msg_ref(msg);
+    eb_sub_tbl_ref(msg->subs);
+    eb_sub_tbl_ref(msg->psubs);
+
+    while((worker = eb_worker_place(&work)) == NULL){
+        if(timeout == 0){
+            break;
         }
-        worker->thread = eb_thread_new(worker->name, eb_worker_thread, (void *)worker, EB_WORKER_STACK_SIZE, EB_WORKER_PRIO);
-        if(worker->thread == NULL){
-            eb_log_err("%s failed\n", worker->name);
-            eb_queue_delete(&worker->queue);
-            goto exit;
+
+        if(!waiting){
+            start = eb_get_tick();
+            ticks = EB_MS_TO_TICK(timeout);
+            if(ticks == 0){
+                ticks = 1;
+            }
+            atomic_fetch_add(&waiters, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            waiting = true;
+            continue;
+        }
+
+        elapsed = eb_get_tick() - start;
+        if(elapsed >= ticks){
+            break;
         }
+        eb_sem_take(&space, EB_TICK_TO_MS(ticks - elapsed));
     }
 
-    msg.evt = evt;
-    msg.len = len;
-    msg.data = data;
+    // binary semaphore, a served waiter passes the wakeup on
+    if(waiting && atomic_fetch_sub(&waiters, 1) > 1 && worker != NULL){
+        eb_sem_give(&space);
+    }
 
-    eb_queue_push(&worker->queue, (void *)&msg, EVENT_BUS_LOW_PRIO, 100);
+    if(worker == NULL){
+        eb_msg_release(msg);
+        eb_sub_tbl_release(msg->subs);
+        eb_sub_tbl_release(msg->psubs);
+        eb_stats_count(bus, EB_STATS_CNT_NO_WORKER, 1);
+        eb_log_err("no workers available, drop event id 0x%lx\n", msg->evt_id);
+        return EVT_WORKER_ERR;
+    }
+    eb_trace(EB_TRACE_POST, msg->evt_id, msg->pub_ns, msg->len, worker->id, NULL);
 
-exit:
-    return rc;
+    eb_sem_give(&worker->wake);
+
+    // the event may wait behind a busy worker, let an idle one steal it
+    atomic_thread_fence(memory_order_seq_cst);
+    idle = eb_worker_get_idle();
+    if(idle != NULL && idle != worker){
+        eb_sem_give(&idle->wake);
+    }
+
+    return EVT_BUS_ERR_OK;
 }   
 
 eb_worker_t *eb_worker_get_list(void)
@@ -161,8 +362,64 @@ eb_worker_t *eb_worker_get_list(void)
     return workers;
 }
 
-int32_t eb_worker_init(eb_t *bus)
+uint32_t eb_worker_get_count(void)
+{
+    return nb_workers;
+}
+
+// affinity holds a core mask per worker, it may be NULL
+int32_t eb_worker_init(eb_t *bus, uint32_t nb, const uint32_t *affinity)
 {
+    uint32_t i;
+    eb_worker_t *worker;
+
+    // the pool is shared by every bus, it is started by the first one
+    if(nb_workers > 0){
+        return EVT_BUS_ERR_OK;
+    }
+
+    nb = MIN(nb, MAX_NB_WORKERS);
     memset(workers, 0, sizeof(workers));
-    return 0;
-}
\ No newline at end of file
+
+    if(eb_supv_init()){
+        eb_log_err("supervisor init failed\n");
+        return EVT_WORKER_ERR;
+    }
+
+    atomic_init(&waiters, 0);
+    if(eb_sem_new(&space)){
+        eb_log_err("worker pool sync failed\n");
+        return EVT_WORKER_ERR;
+    }
+
+    for(i = 0 ; i < nb ; i++){
+        worker = &workers[i];
+        worker->id = i;
+        worker->bus = bus;
+        worker->heap_pos = -1;
+        snprintf(worker->name, sizeof(worker->name), "wkr_%ld_th", (long)i);
+
+        if(eb_mutex_new(&worker->lock) || eb_sem_new(&worker->wake)){
+            eb_log_err("%s sync failed\n", worker->name);
+            return EVT_WORKER_ERR;
+        }
+    }
+
+    // workers steal from each other, they all have to exist before any
+    // of them starts
+    nb_workers = nb;
+    for(i = 0 ; i < nb ; i++){
+        worker = &workers[i];
+        worker->thread = eb_thread_new(worker->name, eb_worker_thread, (void *)worker, EB_WORKER_STACK_SIZE, EB_WORKER_PRIO);
+        if(worker->thread == NULL){
+            eb_log_err("%s failed\n", worker->name);
+            return EVT_WORKER_ERR;
+        }
+
+        if(affinity != NULL && eb_thread_set_affinity(worker->thread, affinity[i])){
+            eb_log_warn("%s can't be pinned to 0x%lx\n", worker->name, (unsigned long)affinity[i]);
+        }
+    }
+
+    return EVT_BUS_ERR_OK;
+}
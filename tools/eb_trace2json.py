@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+#
+# MIT License
+#
+# Copyright (c) 2019 Jocelyn Masserot
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal with the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+#  1. The above copyright notice and this permission notice shall be included in all
+#     copies or substantial portions of the Software.
+#  2. Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimers in the
+#     documentation and/or other materials provided with the distribution.
+#  3. Neither the name of Jocelyn Masserot, nor the names of its contributors
+#     may be used to endorse or promote products derived from this Software
+#     without specific prior written permission.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# WITH THE SOFTWARE.
+
+# Converts an eb_trace_dump() output to the Chrome trace format, open the
+# result in https://ui.perfetto.dev or chrome://tracing.
+#
+#   eb_trace2json.py trace.bin [-o trace.json] [--big-endian]
+#
+# Callbacks are slices on the thread that ran them, the other stages are
+# instants. Flow arrows follow each message from its publish to its
+# callbacks, messages are matched on event id and publish timestamp.
+
+import argparse
+import json
+import struct
+import sys
+
+EB_TRACE_MAGIC = 0x52544245
+EB_TRACE_VERSION = 1
+
+# enum eb_trace_stage
+STAGES = ["pub", "enqueue", "reject", "dequeue", "post", "cb_start", "cb_end", "timeout", "defer"]
+ARGS = ["prio", "dispatcher", "dispatcher", "dispatcher", "worker", None, None, "worker", "sub"]
+
+# eb_trace_hdr_t, eb_trace_rec_t
+HDR = "IHH"
+REC = "QIIIHBB8s"
+
+
+def read_records(data, endian):
+    magic, version, rec_size = struct.unpack_from(endian + HDR, data, 0)
+    if magic != EB_TRACE_MAGIC:
+        raise ValueError("not an event bus trace, or wrong byte order")
+    if version != EB_TRACE_VERSION:
+        raise ValueError("unsupported trace version %d" % version)
+    if rec_size != struct.calcsize(endian + REC):
+        raise ValueError("unexpected record size %d" % rec_size)
+
+    recs = []
+    for off in range(struct.calcsize(endian + HDR), len(data) - rec_size + 1, rec_size):
+        ts, evt_id, key, length, thread, stage, arg, name = struct.unpack_from(endian + REC, data, off)
+        recs.append({
+            "ts": ts,
+            "evt_id": evt_id,
+            "key": key,
+            "len": length,
+            "thread": thread,
+            "stage": stage,
+            "arg": arg,
+            "name": name.split(b"\0", 1)[0].decode("ascii", "replace"),
+        })
+
+    recs.sort(key=lambda r: r["ts"])
+    return recs
+
+
+def thread_names(recs):
+    # bus threads are recognized by the stages they record
+    names = {}
+    for rec in recs:
+        stage = STAGES[rec["stage"]] if rec["stage"] < len(STAGES) else None
+        if stage == "dequeue":
+            names[rec["thread"]] = "dispatcher %d" % rec["arg"]
+        elif stage == "cb_start" and rec["thread"] not in names:
+            names[rec["thread"]] = "worker"
+        elif stage == "pub":
+            names.setdefault(rec["thread"], "publisher")
+
+    return {thread: "%s (%d)" % (name, thread) for thread, name in names.items()}
+
+
+def convert(recs):
+    events = []
+    flows = {}
+    # the dump starts with the oldest records, callbacks may have lost their start
+    open_cbs = {}
+
+    for thread, name in thread_names(recs).items():
+        events.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": thread, "args": {"name": name}})
+
+    for rec in recs:
+        if rec["stage"] >= len(STAGES):
+            continue
+
+        stage = STAGES[rec["stage"]]
+        ts = rec["ts"] / 1000.0
+        tid = rec["thread"]
+        args = {"evt_id": "0x%08x" % rec["evt_id"], "len": rec["len"]}
+        if ARGS[rec["stage"]] is not None:
+            args[ARGS[rec["stage"]]] = rec["arg"]
+
+        if stage == "cb_start":
+            open_cbs[tid] = open_cbs.get(tid, 0) + 1
+            events.append({"ph": "B", "name": "%s 0x%x" % (rec["name"], rec["evt_id"]), "cat": "cb",
+                           "ts": ts, "pid": 0, "tid": tid, "args": args})
+        elif stage == "cb_end":
+            if open_cbs.get(tid, 0) == 0:
+                continue
+            open_cbs[tid] -= 1
+            events.append({"ph": "E", "ts": ts, "pid": 0, "tid": tid})
+        else:
+            events.append({"ph": "i", "s": "t", "name": "%s 0x%x" % (stage, rec["evt_id"]), "cat": stage,
+                           "ts": ts, "pid": 0, "tid": tid, "args": args})
+
+        # a flow step per stage of the message, bound to the slice or instant above
+        if stage != "cb_end":
+            msg = (rec["evt_id"], rec["key"])
+            flow_id = flows.setdefault(msg, len(flows) + 1)
+            events.append({"ph": "t" if stage != "pub" else "s", "id": flow_id, "name": "msg", "cat": "msg",
+                           "ts": ts, "pid": 0, "tid": tid, "bp": "e"})
+
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="event bus trace to Chrome trace JSON")
+    parser.add_argument("trace", help="eb_trace_dump() output")
+    parser.add_argument("-o", "--output", help="JSON file, stdout by default")
+    parser.add_argument("--big-endian", action="store_true", help="trace recorded on a big endian target")
+    opts = parser.parse_args()
+
+    with open(opts.trace, "rb") as f:
+        data = f.read()
+
+    try:
+        recs = read_records(data, ">" if opts.big_endian else "<")
+    except (ValueError, struct.error) as err:
+        sys.exit("%s: %s" % (opts.trace, err))
+
+    out = open(opts.output, "w") if opts.output else sys.stdout
+    json.dump(convert(recs), out)
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()